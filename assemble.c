@@ -0,0 +1,65 @@
+/* Assembles a program into a program image ; ./sim, sweep and sample load it without parsing */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "cpu.h"
+#include "image.h"
+
+void print_args() {
+	printf("./assemble [--output file.img] <file.asm>\n");
+	printf("./assemble --info <file.img|file.asm>\n");
+	printf("  default output is the input name with .img in place of .asm\n");
+	printf("  --info prints the sizes and the checksum instead of writing an image\n");
+}
+
+// file.asm -> file.img ; anything else just gets .img added
+static char* image_name(const char* filename) {
+	size_t len = strlen(filename);
+	char* name = malloc(len + 5);
+	if(!name) return NULL;
+	strcpy(name, filename);
+	if(len > 4 && strcmp(name + len - 4, ".asm") == 0) name[len - 4] = '\0';
+	strcat(name, ".img");
+	return name;
+}
+
+int main(int argc, char* argv[]) {
+	char info = 0;
+	const char* output = NULL;
+	const char* filename = NULL;
+	for(int i=1; i<argc; i++) {
+		if(strcmp(argv[i], "--info") == 0) info = 1;
+		else if(strcmp(argv[i], "--output") == 0 && i+1 < argc) output = argv[++i];
+		else if(argv[i][0] != '-' && !filename) filename = argv[i];
+		else {
+			print_args();
+			exit(1);
+		}
+	}
+	if(!filename) {
+		print_args();
+		exit(1);
+	}
+
+	program_t prog;
+	if(program_load(filename, &prog)) {
+		fprintf(stderr, "assemble> Failed to load %s\n", filename);
+		exit(1);
+	}
+	if(info) {
+		printf("%s: %s, %d insn, %d data words, checksum %016" PRIx64 "\n", filename, prog.map ? "image" : "text", prog.code_size, prog.data_size, image_checksum(&prog));
+		program_free(&prog);
+		return 0;
+	}
+
+	char* name = output ? NULL : image_name(filename);
+	if(!output) output = name;
+	int failed = !output || image_save(&prog, output);
+	if(failed) fprintf(stderr, "assemble> Failed to write %s\n", output ? output : filename);
+	free(name);
+	program_free(&prog);
+	return failed;
+}
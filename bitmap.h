@@ -0,0 +1,67 @@
+#ifndef BITMAP_H
+#define BITMAP_H
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+
+	Bitmaps of 64-bit words ; bit i of map is (map[i / 64] >> (i % 64)) & 1
+
+	the queues keep their per-entry flags here, so the lowest free entry is a find-first-set and a scan only visits entries in use
+
+*/
+
+static inline int bitmap_words(int n) {
+	return (n + 63) / 64;
+}
+
+static inline void bitmap_set(uint64_t* map, int i) {
+	map[i / 64] |= (uint64_t) 1 << (i % 64);
+}
+
+static inline void bitmap_clear(uint64_t* map, int i) {
+	map[i / 64] &= ~((uint64_t) 1 << (i % 64));
+}
+
+static inline char bitmap_test(const uint64_t* map, int i) {
+	return (map[i / 64] >> (i % 64)) & 1;
+}
+
+// sets bits 0 to n-1 ; everything free at once
+static inline void bitmap_fill(uint64_t* map, int n) {
+	memset(map, 0, bitmap_words(n) * sizeof(uint64_t));
+	for(int w=0; w<n/64; w++) {
+		map[w] = ~(uint64_t) 0;
+	}
+	if(n % 64) map[n / 64] = ((uint64_t) 1 << (n % 64)) - 1;
+}
+
+// lowest bit at or after i that equals value ; -1 if none
+static inline int bitmap_scan(const uint64_t* map, int n, int i, char value) {
+	if(i >= n) return -1;
+	uint64_t flip = value ? 0 : ~(uint64_t) 0;
+	uint64_t bits = (map[i / 64] ^ flip) & (~(uint64_t) 0 << (i % 64));
+	for(int w=i/64; ; ) {
+		if(bits) {
+			int bit = w * 64 + __builtin_ctzll(bits);
+			return bit < n ? bit : -1;
+		}
+		if(++w >= bitmap_words(n)) return -1;
+		bits = map[w] ^ flip;
+	}
+}
+
+static inline int bitmap_next(const uint64_t* map, int n, int i) {
+	return bitmap_scan(map, n, i, 1);
+}
+
+static inline int bitmap_next_clear(const uint64_t* map, int n, int i) {
+	return bitmap_scan(map, n, i, 0);
+}
+
+static inline int bitmap_first(const uint64_t* map, int n) {
+	return bitmap_next(map, n, 0);
+}
+
+#endif // BITMAP_H
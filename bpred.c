@@ -0,0 +1,237 @@
+/* Branch predictors ; static, bimodal, gshare and a small TAGE, plus the BTB and RAS they share */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bpred.h"
+
+#define TAGE_TAG_BITS 9
+#define TAGE_NO_TAG 0xffff // never produced by tage_tag()
+
+static const int tage_hist_len[TAGE_TABLES] = { 4, 8, 16, 32 }; // geometric history lengths
+
+int bpred_init(bpred_t* bp, const config_t* config) {
+	memset(bp, 0, sizeof(bpred_t));
+	bp->type = config->bpred;
+	bp->bits = config->bpred_bits;
+	bp->btb_size = config->btb_size;
+	bp->ras_size = config->ras_size;
+	if(bp->type == BPRED_NONE) return 0; // fetch always falls through ; nothing to allocate
+	if(bp->bits > 24) return -1; // 16M counters is already far beyond any real table
+
+	bp->counters = malloc(1 << bp->bits);
+	bp->btb = malloc(bp->btb_size * sizeof(btb_entry_t));
+	bp->ras = calloc(bp->ras_size, sizeof(int));
+	if(!bp->counters || !bp->btb || !bp->ras) return -1;
+
+	memset(bp->counters, 1, 1 << bp->bits); // weakly not taken
+	for(int i=0; i<bp->btb_size; i++) {
+		bp->btb[i].pc = -1;
+	}
+
+	if(bp->type == BPRED_TAGE) {
+		bp->tage_bits = bp->bits - 2; // each tagged component is a quarter of the base table
+		for(int t=0; t<TAGE_TABLES; t++) {
+			bp->tage[t] = calloc(1 << bp->tage_bits, sizeof(tage_entry_t));
+			if(!bp->tage[t]) return -1;
+			for(int i=0; i<(1 << bp->tage_bits); i++) {
+				bp->tage[t][i].tag = TAGE_NO_TAG;
+			}
+		}
+	}
+	return 0;
+}
+
+void bpred_free(bpred_t* bp) {
+	for(int t=0; t<TAGE_TABLES; t++) {
+		free(bp->tage[t]);
+	}
+	free(bp->ras);
+	free(bp->btb);
+	free(bp->counters);
+}
+
+static unsigned pc_hash(int pc) {
+	return (unsigned) pc >> 2;
+}
+
+// xor-folds the youngest len bits of history down to bits bits
+static unsigned fold(uint64_t h, int len, int bits) {
+	if(len < 64) h &= ((uint64_t) 1 << len) - 1;
+	unsigned f = 0;
+	while(h) {
+		f ^= h & ((1u << bits) - 1);
+		h >>= bits;
+	}
+	return f;
+}
+
+static int counter_index(bpred_t* bp, int pc, uint64_t ghist) {
+	unsigned mask = (1u << bp->bits) - 1;
+	if(bp->type == BPRED_GSHARE) return (pc_hash(pc) ^ fold(ghist, bp->bits, bp->bits)) & mask;
+	return pc_hash(pc) & mask;
+}
+
+static void counter_update(unsigned char* c, char taken) {
+	if(taken && *c < 3) (*c)++;
+	if(!taken && *c > 0) (*c)--;
+}
+
+static int tage_index(bpred_t* bp, int t, int pc, uint64_t ghist) {
+	unsigned mask = (1u << bp->tage_bits) - 1;
+	return (pc_hash(pc) ^ (pc_hash(pc) >> bp->tage_bits) ^ fold(ghist, tage_hist_len[t], bp->tage_bits)) & mask;
+}
+
+static unsigned short tage_tag(int t, int pc, uint64_t ghist) {
+	unsigned tag = pc_hash(pc) ^ fold(ghist, tage_hist_len[t], TAGE_TAG_BITS) ^ (fold(ghist, tage_hist_len[t], TAGE_TAG_BITS - 1) << 1);
+	return tag & ((1 << TAGE_TAG_BITS) - 1);
+}
+
+// direction of BZ and BNZ
+static char predict_taken(bpred_t* bp, int pc, int target, bpred_info_t* info) {
+	switch(bp->type) {
+		case BPRED_STATIC:
+			return target < pc; // backward taken, forward not taken
+
+		case BPRED_BIMODAL:
+		case BPRED_GSHARE:
+			return bp->counters[counter_index(bp, pc, bp->ghist)] >= 2;
+
+		case BPRED_TAGE: {
+			// the longest history that hits provides the prediction, the next longest is the alternate
+			char pred = bp->counters[counter_index(bp, pc, bp->ghist)] >= 2;
+			info->alt_taken = pred;
+			for(int t=0; t<TAGE_TABLES; t++) {
+				tage_entry_t* e = &bp->tage[t][tage_index(bp, t, pc, bp->ghist)];
+				if(e->tag != tage_tag(t, pc, bp->ghist)) continue;
+				info->alt_taken = pred;
+				pred = e->ctr >= 0;
+				info->provider = t;
+			}
+			return pred;
+		}
+	}
+	return 0;
+}
+
+static void ras_push(bpred_t* bp, int ret) {
+	bp->ras[bp->ras_top] = ret;
+	bp->ras_top = (bp->ras_top + 1) % bp->ras_size;
+	if(bp->ras_num < bp->ras_size) bp->ras_num++;
+}
+
+static int ras_pop(bpred_t* bp) {
+	bp->ras_top = (bp->ras_top + bp->ras_size - 1) % bp->ras_size;
+	bp->ras_num--;
+	return bp->ras[bp->ras_top];
+}
+
+int bpred_predict(bpred_t* bp, int pc, int kind, int target, bpred_info_t* info) {
+	info->next_pc = pc + 4;
+	info->taken = 0;
+	info->from_ras = 0;
+	info->provider = -1;
+	info->alt_taken = 0;
+	bp->lookups++;
+	if(bp->type == BPRED_NONE) return info->next_pc;
+
+	info->ghist = bp->ghist;
+	info->ras_top = bp->ras_top;
+	info->ras_num = bp->ras_num;
+	info->ras_val = bp->ras[bp->ras_top];
+
+	if(kind == BR_COND) {
+		info->taken = predict_taken(bp, pc, target, info);
+		if(info->taken) info->next_pc = target;
+		bp->ghist = (bp->ghist << 1) | info->taken;
+		return info->next_pc;
+	}
+
+	// a JUMP returns to the most recent JAL ; otherwise the target has to be in the BTB
+	if(kind == BR_INDIRECT && bp->ras_num > 0) {
+		info->from_ras = 1;
+		info->taken = 1;
+		info->next_pc = ras_pop(bp);
+	} else {
+		btb_entry_t* e = &bp->btb[pc_hash(pc) % bp->btb_size];
+		if(e->pc == pc) {
+			info->taken = 1;
+			info->next_pc = e->target;
+		}
+	}
+	if(kind == BR_CALL) ras_push(bp, pc + 4);
+	return info->next_pc;
+}
+
+static void tage_update(bpred_t* bp, int pc, char taken, const bpred_info_t* info) {
+	uint64_t h = info->ghist;
+	int p = info->provider;
+
+	tage_entry_t* e = p >= 0 ? &bp->tage[p][tage_index(bp, p, pc, h)] : NULL;
+	if(e && e->tag == tage_tag(p, pc, h)) { // provider may have been replaced since the prediction
+		if(taken && e->ctr < 3) e->ctr++;
+		if(!taken && e->ctr > -4) e->ctr--;
+		if(info->taken != info->alt_taken) { // the provider decided the prediction
+			if(info->taken == taken && e->u < 3) e->u++;
+			if(info->taken != taken && e->u > 0) e->u--;
+		}
+	} else {
+		counter_update(&bp->counters[counter_index(bp, pc, h)], taken);
+	}
+
+	// on a miss, take over one entry with a longer history ; age them all if none is free
+	if(info->taken == taken) return;
+	for(int t=p+1; t<TAGE_TABLES; t++) {
+		tage_entry_t* n = &bp->tage[t][tage_index(bp, t, pc, h)];
+		if(n->u == 0) {
+			n->tag = tage_tag(t, pc, h);
+			n->ctr = taken ? 0 : -1;
+			return;
+		}
+	}
+	for(int t=p+1; t<TAGE_TABLES; t++) {
+		tage_entry_t* n = &bp->tage[t][tage_index(bp, t, pc, h)];
+		if(n->u > 0) n->u--;
+	}
+}
+
+void bpred_update(bpred_t* bp, int pc, int kind, char taken, int next_pc, const bpred_info_t* info) {
+	if(bp->type == BPRED_NONE) return;
+
+	if(kind != BR_COND) { // JAL and JUMP are always taken ; remember where they went
+		btb_entry_t* e = &bp->btb[pc_hash(pc) % bp->btb_size];
+		e->pc = pc;
+		e->target = next_pc;
+		return;
+	}
+
+	switch(bp->type) {
+		case BPRED_BIMODAL:
+		case BPRED_GSHARE:
+			counter_update(&bp->counters[counter_index(bp, pc, info->ghist)], taken);
+			break;
+		case BPRED_TAGE:
+			tage_update(bp, pc, taken, info);
+			break;
+	}
+}
+
+void bpred_restore(bpred_t* bp, const bpred_info_t* info) {
+	if(bp->type == BPRED_NONE) return;
+	bp->ghist = info->ghist;
+	bp->ras_top = info->ras_top;
+	bp->ras_num = info->ras_num;
+	bp->ras[bp->ras_top] = info->ras_val;
+}
+
+void bpred_recover(bpred_t* bp, int pc, int kind, char taken, const bpred_info_t* info) {
+	bp->mispredicts++;
+	if(bp->type == BPRED_NONE) return;
+
+	// back to the state before this insn, then replay it with the real outcome
+	bpred_restore(bp, info);
+
+	if(kind == BR_COND) bp->ghist = (bp->ghist << 1) | taken;
+	else if(kind == BR_CALL) ras_push(bp, pc + 4);
+	else if(info->from_ras) ras_pop(bp);
+}
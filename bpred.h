@@ -0,0 +1,74 @@
+#ifndef BPRED_H
+#define BPRED_H
+
+#include <stdint.h>
+
+#include "config.h"
+
+/*
+
+	Branch prediction ; fetch asks for the next pc of every control-flow insn
+
+*/
+
+#define TAGE_TABLES 4 // tagged components on top of the base table
+
+// control-flow kinds ; targets of BZ/BNZ are known at fetch, JAL and JUMP go through the BTB (JUMP through the RAS first)
+enum { BR_COND, BR_CALL, BR_INDIRECT };
+
+// what fetch predicted for one control-flow insn ; kept with its cfid until the insn resolves
+typedef struct bpred_info_t {
+	int next_pc; // predicted fetch address after this insn
+	char taken;
+
+	// predictor state before this insn, restored on a misprediction
+	uint64_t ghist;
+	int ras_top;
+	int ras_num;
+	int ras_val; // entry the insn may have overwritten
+	char from_ras; // JUMP target came from the RAS
+
+	int provider; // TAGE component that predicted ; -1 for the base table
+	char alt_taken; // TAGE prediction without the provider
+} bpred_info_t;
+
+typedef struct btb_entry_t {
+	int pc; // -1 if empty
+	int target;
+} btb_entry_t;
+
+typedef struct tage_entry_t {
+	signed char ctr; // -4 .. 3 ; taken if >= 0
+	unsigned short tag;
+	unsigned char u; // usefulness
+} tage_entry_t;
+
+typedef struct bpred_t {
+	int type; // BPRED_*
+	int bits; // log2 of counters entries
+
+	unsigned char* counters; // 2-bit counters ; bimodal, gshare and the TAGE base table
+	tage_entry_t* tage[TAGE_TABLES];
+	int tage_bits;
+	uint64_t ghist; // speculative global history, youngest branch in bit 0
+
+	btb_entry_t* btb;
+	int btb_size;
+
+	int* ras;
+	int ras_size;
+	int ras_top; // index of the next free entry ; wraps around, the oldest return is overwritten
+	int ras_num; // valid entries
+
+	int lookups; // control-flow insn predicted
+	int mispredicts;
+} bpred_t;
+
+int bpred_init(bpred_t* bp, const config_t* config); // 0 on success
+void bpred_free(bpred_t* bp);
+int bpred_predict(bpred_t* bp, int pc, int kind, int target, bpred_info_t* info); // returns the next fetch address ; target is only used by BR_COND
+void bpred_update(bpred_t* bp, int pc, int kind, char taken, int next_pc, const bpred_info_t* info); // trains on the resolved outcome
+void bpred_recover(bpred_t* bp, int pc, int kind, char taken, const bpred_info_t* info); // rewinds speculative state after a misprediction
+void bpred_restore(bpred_t* bp, const bpred_info_t* info); // speculative state as it was before the insn info belongs to ; nothing replayed
+
+#endif // BPRED_H
@@ -0,0 +1,209 @@
+/* Data cache hierarchy ; tags, replacement and MSHRs, timing only */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+
+static const char* const level_names[MAX_CACHE_LEVELS] = { "l1d", "l2" };
+
+static int level_init(cache_level_t* l, int size, int assoc, int line, int lat, int repl) {
+	memset(l, 0, sizeof(cache_level_t));
+	l->assoc = assoc;
+	l->line = line;
+	l->lat = lat;
+	l->sets = size / (assoc * line);
+	l->lines = malloc(l->sets * assoc * sizeof(cache_line_t));
+	if(!l->lines) return -1;
+	for(int i=0; i<l->sets * assoc; i++) {
+		l->lines[i].tag = -1;
+		l->lines[i].dirty = 0;
+		l->lines[i].stamp = 0;
+	}
+	if(repl == CACHE_REPL_PLRU && assoc > 1) {
+		l->plru = calloc(l->sets * (assoc - 1), sizeof(unsigned char));
+		if(!l->plru) return -1;
+	}
+	return 0;
+}
+
+int cache_init(cache_t* cache, const config_t* config) {
+	memset(cache, 0, sizeof(cache_t));
+	if(!config->l1d_size) return 0; // memFU keeps its flat latency
+
+	cache->repl = config->cache_repl;
+	cache->mem_lat = config->mem_lat;
+	cache->levels = config->l2_size ? 2 : 1;
+	if(level_init(&cache->level[0], config->l1d_size, config->l1d_assoc, config->l1d_line, config->l1d_lat, cache->repl)) return -1;
+	if(cache->levels > 1 && level_init(&cache->level[1], config->l2_size, config->l2_assoc, config->l2_line, config->l2_lat, cache->repl)) return -1;
+
+	cache->num_mshrs = config->mshrs;
+	cache->mshr = malloc(cache->num_mshrs * sizeof(mshr_t));
+	if(!cache->mshr) return -1;
+	for(int i=0; i<cache->num_mshrs; i++) {
+		cache->mshr[i].line = -1;
+		cache->mshr[i].ready = 0;
+	}
+	return 0;
+}
+
+void cache_free(cache_t* cache) {
+	for(int i=0; i<MAX_CACHE_LEVELS; i++) {
+		free(cache->level[i].lines);
+		free(cache->level[i].plru);
+	}
+	free(cache->mshr);
+}
+
+// way holding line in its set ; -1 on a miss
+static int lookup(const cache_level_t* l, int line) {
+	const cache_line_t* set = &l->lines[(line % l->sets) * l->assoc];
+	for(int w=0; w<l->assoc; w++) {
+		if(set[w].tag == line) return w;
+	}
+	return -1;
+}
+
+static void touch(cache_level_t* l, int line, int way) {
+	int set = line % l->sets;
+	l->lines[set * l->assoc + way].stamp = ++l->clock;
+	if(!l->plru) return;
+
+	// every node on the way up points at the other half
+	unsigned char* tree = &l->plru[set * (l->assoc - 1)];
+	int node = l->assoc - 1 + way;
+	while(node > 0) {
+		int parent = (node - 1) / 2;
+		tree[parent] = (node == 2 * parent + 1);
+		node = parent;
+	}
+}
+
+static int victim(const cache_level_t* l, int line) {
+	int set = line % l->sets;
+	const cache_line_t* ways = &l->lines[set * l->assoc];
+	for(int w=0; w<l->assoc; w++) {
+		if(ways[w].tag == -1) return w;
+	}
+
+	if(l->plru) { // follow the bits down to a leaf
+		const unsigned char* tree = &l->plru[set * (l->assoc - 1)];
+		int node = 0;
+		while(node < l->assoc - 1) {
+			node = 2 * node + 1 + tree[node];
+		}
+		return node - (l->assoc - 1);
+	}
+	int lru = 0;
+	for(int w=1; w<l->assoc; w++) {
+		if(ways[w].stamp < ways[lru].stamp) lru = w;
+	}
+	return lru;
+}
+
+static void install(cache_t* cache, int lvl, int addr, char dirty);
+
+// a dirty line leaving level lvl ; the next level takes it, memory needs nothing
+static void write_back(cache_t* cache, int lvl, int addr) {
+	if(lvl == cache->levels) return;
+	cache_level_t* l = &cache->level[lvl];
+	int line = addr / l->line;
+	int way = lookup(l, line);
+	if(way == -1) install(cache, lvl, addr, 1);
+	else l->lines[(line % l->sets) * l->assoc + way].dirty = 1;
+}
+
+static void install(cache_t* cache, int lvl, int addr, char dirty) {
+	cache_level_t* l = &cache->level[lvl];
+	int line = addr / l->line;
+	int way = victim(l, line);
+	cache_line_t* cl = &l->lines[(line % l->sets) * l->assoc + way];
+	if(cl->tag != -1 && cl->dirty) {
+		l->writebacks++;
+		write_back(cache, lvl + 1, cl->tag * l->line);
+	}
+	cl->tag = line;
+	cl->dirty = dirty;
+	touch(l, line, way);
+}
+
+// latency of bringing addr into level lvl from below ; fills every level it missed on the way
+static int fetch_line(cache_t* cache, int lvl, int addr) {
+	if(lvl == cache->levels) return cache->mem_lat;
+	cache_level_t* l = &cache->level[lvl];
+	int line = addr / l->line;
+	l->accesses++;
+	int way = lookup(l, line);
+	if(way != -1) {
+		l->hits++;
+		touch(l, line, way);
+		return l->lat;
+	}
+	l->misses++;
+	int lat = l->lat + fetch_line(cache, lvl + 1, addr);
+	install(cache, lvl, addr, 0);
+	return lat;
+}
+
+int cache_access(cache_t* cache, int addr, char write, int now) {
+	cache_level_t* l1 = &cache->level[0];
+	int line = addr / l1->line;
+
+	mshr_t* free_mshr = NULL;
+	for(int i=0; i<cache->num_mshrs; i++) {
+		mshr_t* m = &cache->mshr[i];
+		if(m->ready <= now) { // filled ; free again
+			m->line = -1;
+			if(!free_mshr) free_mshr = m;
+		} else if(m->line == line) { // already on the way ; the line is installed, the data is not
+			l1->accesses++;
+			l1->misses++;
+			cache->merged++;
+			int way = lookup(l1, line);
+			if(way != -1) {
+				touch(l1, line, way);
+				if(write) l1->lines[(line % l1->sets) * l1->assoc + way].dirty = 1;
+			}
+			return m->ready - now;
+		}
+	}
+
+	int way = lookup(l1, line);
+	if(way != -1) {
+		l1->accesses++;
+		l1->hits++;
+		touch(l1, line, way);
+		if(write) l1->lines[(line % l1->sets) * l1->assoc + way].dirty = 1;
+		return l1->lat;
+	}
+	if(!free_mshr) {
+		cache->mshr_full++;
+		return -1;
+	}
+
+	// write-allocate ; a STORE miss fetches the line like a LOAD and leaves it dirty
+	l1->accesses++;
+	l1->misses++;
+	int lat = l1->lat + fetch_line(cache, 1, addr);
+	install(cache, 0, addr, write);
+	free_mshr->line = line;
+	free_mshr->ready = now + lat;
+	return lat;
+}
+
+void cache_print(const cache_t* cache, FILE* out) {
+	for(int i=0; i<cache->levels; i++) {
+		const cache_level_t* l = &cache->level[i];
+		fprintf(out, "%-4s accesses %-9d hits %-9d misses %-9d %5.1f%%  writebacks %d\n", level_names[i], l->accesses, l->hits, l->misses, l->accesses ? 100.0 * l->misses / l->accesses : 0.0, l->writebacks);
+	}
+	fprintf(out, "mshr merged %d  full %d\n", cache->merged, cache->mshr_full);
+}
+
+void cache_json(const cache_t* cache, FILE* out) {
+	fprintf(out, "{");
+	for(int i=0; i<cache->levels; i++) {
+		const cache_level_t* l = &cache->level[i];
+		fprintf(out, "\"%s\": {\"accesses\": %d, \"hits\": %d, \"misses\": %d, \"writebacks\": %d}, ", level_names[i], l->accesses, l->hits, l->misses, l->writebacks);
+	}
+	fprintf(out, "\"mshr_merged\": %d, \"mshr_full\": %d}", cache->merged, cache->mshr_full);
+}
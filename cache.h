@@ -0,0 +1,64 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdio.h> // FILE
+
+#include "config.h"
+
+/*
+
+	Data caches in front of cpu->memory ; L1D and an optional L2, write-back and write-allocate
+
+	only tags and state are kept ; the data itself always lives in cpu->memory, so the caches change timing and never values
+	sizes are in words, like mem_size ; a dirty line written back is buffered and costs no time
+
+*/
+
+#define MAX_CACHE_LEVELS 2
+
+typedef struct cache_line_t {
+	int tag; // line address ; -1 if invalid
+	char dirty;
+	unsigned int stamp; // last use ; LRU evicts the smallest
+} cache_line_t;
+
+typedef struct cache_level_t {
+	int sets;
+	int assoc;
+	int line; // words per line
+	int lat; // hit latency
+	cache_line_t* lines; // sets * assoc ; way w of set s at s * assoc + w
+	unsigned char* plru; // sets * (assoc - 1) tree bits ; NULL unless PLRU
+	unsigned int clock; // LRU stamps
+
+	int accesses;
+	int hits;
+	int misses;
+	int writebacks; // dirty lines evicted
+} cache_level_t;
+
+// one L1D miss in flight ; later misses to the same line wait for it instead of taking another
+typedef struct mshr_t {
+	int line; // L1D line address ; -1 if free
+	int ready; // cycle the line arrives
+} mshr_t;
+
+typedef struct cache_t {
+	int levels; // 0 when the caches are off ; memFU then takes mem_fu_lat for everything
+	int repl; // CACHE_REPL_*
+	int mem_lat; // behind the last level
+	cache_level_t level[MAX_CACHE_LEVELS];
+
+	mshr_t* mshr;
+	int num_mshrs;
+	int merged; // misses that found their line already on the way
+	int mshr_full; // accesses turned away because every MSHR was busy
+} cache_t;
+
+int cache_init(cache_t* cache, const config_t* config); // 0 on success
+void cache_free(cache_t* cache);
+int cache_access(cache_t* cache, int addr, char write, int now); // cycles until the word is there ; -1 if it has to retry, every MSHR busy
+void cache_print(const cache_t* cache, FILE* out);
+void cache_json(const cache_t* cache, FILE* out);
+
+#endif // CACHE_H
@@ -0,0 +1,256 @@
+/* Checkpoints ; saves a running cpu_t to disk and rebuilds it from the file */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "ckpt.h"
+
+#define MAX_SECTIONS 48
+
+// one dynamically sized array of the cpu
+typedef struct section_t {
+	void* data;
+	size_t size;
+} section_t;
+
+// every array behind a cpu_t pointer except memory, in file order ; sizes only depend on the config
+static int cpu_sections(const cpu_t* cpu, section_t* s) {
+	const config_t* c = &cpu->config;
+	int n = 0;
+	#define SECTION(ptr, bytes) do { s[n].data = (void*) (ptr); s[n].size = (bytes); n++; } while(0)
+	SECTION(cpu->code, cpu->code_size * sizeof(insn_t));
+	SECTION(cpu->unified_regs, c->num_unified_regs * sizeof(ureg_t));
+	SECTION(cpu->free_regs, c->num_unified_regs * sizeof(int));
+	SECTION(cpu->stage[F].slots, 3 * c->width * sizeof(stage_t)); // one block for every latch
+	SECTION(cpu->rob.entries, c->rob_size * sizeof(rob_entry_t));
+	SECTION(cpu->rob.taken, bitmap_words(c->rob_size) * sizeof(uint64_t));
+	SECTION(cpu->rob.cfid, c->rob_size * sizeof(int));
+	SECTION(cpu->rob.brmask, (size_t) c->cfq_size * bitmap_words(c->rob_size) * sizeof(uint64_t));
+	SECTION(cpu->iq, c->iq_size * sizeof(iq_entry_t));
+	SECTION(cpu->iq_free, bitmap_words(c->iq_size) * sizeof(uint64_t));
+	SECTION(cpu->iq_cfid, c->iq_size * sizeof(int));
+	SECTION(cpu->iq_ready, (size_t) NUM_FU_TYPES * bitmap_words(c->iq_size) * sizeof(uint64_t));
+	SECTION(cpu->iq_age, (size_t) c->iq_size * bitmap_words(c->iq_size) * sizeof(uint64_t));
+	SECTION(cpu->iq_brmask, (size_t) c->cfq_size * bitmap_words(c->iq_size) * sizeof(uint64_t));
+	SECTION(cpu->lsq.entries, c->lsq_size * sizeof(lsq_entry_t));
+	SECTION(cpu->lsq.taken, bitmap_words(c->lsq_size) * sizeof(uint64_t));
+	SECTION(cpu->lsq.cfid, c->lsq_size * sizeof(int));
+	SECTION(cpu->lsq.brmask, (size_t) c->cfq_size * bitmap_words(c->lsq_size) * sizeof(uint64_t));
+	SECTION(cpu->wait_head, c->num_unified_regs * sizeof(int));
+	SECTION(cpu->wait_nodes, (c->iq_size * NUM_IQ_WAITS + c->lsq_size) * sizeof(wait_node_t));
+	for(int t=0; t<NUM_FU_TYPES; t++) {
+		SECTION(cpu->fu[t].slots, cpu->fu[t].units * cpu->fu[t].depth * sizeof(fu_t));
+	}
+	SECTION(cpu->memFU, cpu->mem_slots * sizeof(fu_t));
+	SECTION(cpu->cfid_free, bitmap_words(c->cfq_size) * sizeof(uint64_t));
+	SECTION(cpu->unresolved, bitmap_words(c->cfq_size) * sizeof(uint64_t));
+	SECTION(cpu->cfq, c->cfq_size * sizeof(int));
+	SECTION(cpu->saved_state, c->cfq_size * sizeof(saved_state_t));
+	if(cpu->bpred.type != BPRED_NONE) {
+		SECTION(cpu->bpred.counters, (size_t) 1 << cpu->bpred.bits);
+		for(int t=0; t<TAGE_TABLES; t++) {
+			if(cpu->bpred.tage[t]) SECTION(cpu->bpred.tage[t], ((size_t) 1 << cpu->bpred.tage_bits) * sizeof(tage_entry_t));
+		}
+		SECTION(cpu->bpred.btb, cpu->bpred.btb_size * sizeof(btb_entry_t));
+		SECTION(cpu->bpred.ras, cpu->bpred.ras_size * sizeof(int));
+	}
+	SECTION(cpu->perf.iq_hist, (c->iq_size + 1) * sizeof(int));
+	SECTION(cpu->perf.rob_hist, (c->rob_size + 1) * sizeof(int));
+	SECTION(cpu->perf.lsq_hist, (c->lsq_size + 1) * sizeof(int));
+	for(int i=0; i<cpu->cache.levels; i++) {
+		const cache_level_t* l = &cpu->cache.level[i];
+		SECTION(l->lines, l->sets * l->assoc * sizeof(cache_line_t));
+		if(l->plru) SECTION(l->plru, l->sets * (l->assoc - 1));
+	}
+	if(cpu->cache.levels) SECTION(cpu->cache.mshr, cpu->cache.num_mshrs * sizeof(mshr_t));
+	#undef SECTION
+	return n;
+}
+
+static size_t print_info_size(const ckpt_header_t* header) {
+	return header->print_info ? (header->code_size + 1) * sizeof(stage_t) : 0;
+}
+
+static uint64_t mem_offset(const ckpt_header_t* header, const section_t* s, int num) {
+	uint64_t size = sizeof(ckpt_header_t) + sizeof(cpu_t) + print_info_size(header);
+	for(int i=0; i<num; i++) {
+		size += s[i].size;
+	}
+	return (size + CKPT_ALIGN - 1) / CKPT_ALIGN * CKPT_ALIGN;
+}
+
+int cpu_save(const cpu_t* cpu, const char* filename) {
+	section_t s[MAX_SECTIONS];
+	int num = cpu_sections(cpu, s);
+
+	ckpt_header_t header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CKPT_MAGIC, 4);
+	header.version = CKPT_VERSION;
+	header.cpu_size = sizeof(cpu_t);
+	header.code_size = cpu->code_size;
+	header.print_info = cpu->print_info != NULL;
+	header.mem_offset = mem_offset(&header, s, num);
+	header.config = cpu->config;
+
+	FILE* file = fopen(filename, "wb");
+	if(!file) return -1;
+	int failed = fwrite(&header, sizeof(header), 1, file) != 1;
+	failed |= fwrite(cpu, sizeof(cpu_t), 1, file) != 1;
+	for(int i=0; i<num; i++) {
+		if(s[i].size) failed |= fwrite(s[i].data, s[i].size, 1, file) != 1;
+	}
+	if(header.print_info) failed |= fwrite(cpu->print_info, print_info_size(&header), 1, file) != 1;
+	failed |= fseek(file, header.mem_offset, SEEK_SET) != 0; // the gap reads back as zeros
+	failed |= fwrite(cpu->memory, sizeof(int), cpu->config.mem_size, file) != (size_t) cpu->config.mem_size;
+	if(fclose(file)) failed = 1;
+	return failed ? -1 : 0;
+}
+
+// takes the saved run state, keeps everything that belongs to this process
+static void restore_scalars(cpu_t* cpu, const cpu_t* saved) {
+	cpu_t fresh = *cpu;
+	*cpu = *saved;
+
+	cpu->batch = fresh.batch;
+	cpu->display_cycle = 0;
+	cpu->stop_cycle = 0;
+	cpu->stop_insn = 0;
+	cpu->code = fresh.code;
+	cpu->program = fresh.program;
+	cpu->memory = fresh.memory;
+	cpu->unified_regs = fresh.unified_regs;
+	cpu->free_regs = fresh.free_regs;
+	for(int i=0; i<NUM_STAGES; i++) {
+		cpu->stage[i].slots = fresh.stage[i].slots;
+	}
+	cpu->rob.entries = fresh.rob.entries;
+	cpu->rob.taken = fresh.rob.taken;
+	cpu->rob.cfid = fresh.rob.cfid;
+	cpu->iq = fresh.iq;
+	cpu->iq_free = fresh.iq_free;
+	cpu->iq_cfid = fresh.iq_cfid;
+	cpu->iq_ready = fresh.iq_ready;
+	cpu->iq_age = fresh.iq_age;
+	cpu->lsq.entries = fresh.lsq.entries;
+	cpu->lsq.taken = fresh.lsq.taken;
+	cpu->lsq.cfid = fresh.lsq.cfid;
+	cpu->tag_mask = fresh.tag_mask;
+	cpu->rob.brmask = fresh.rob.brmask;
+	cpu->iq_brmask = fresh.iq_brmask;
+	cpu->lsq.brmask = fresh.lsq.brmask;
+	cpu->wait_head = fresh.wait_head;
+	cpu->wait_nodes = fresh.wait_nodes;
+	for(int t=0; t<NUM_FU_TYPES; t++) {
+		cpu->fu[t].slots = fresh.fu[t].slots;
+	}
+	cpu->memFU = fresh.memFU;
+	cpu->cfid_free = fresh.cfid_free;
+	cpu->unresolved = fresh.unresolved;
+	cpu->cfq = fresh.cfq;
+	cpu->saved_state = fresh.saved_state;
+	cpu->bpred.counters = fresh.bpred.counters;
+	for(int t=0; t<TAGE_TABLES; t++) {
+		cpu->bpred.tage[t] = fresh.bpred.tage[t];
+	}
+	cpu->bpred.btb = fresh.bpred.btb;
+	cpu->bpred.ras = fresh.bpred.ras;
+	cpu->perf.iq_hist = fresh.perf.iq_hist;
+	cpu->perf.rob_hist = fresh.perf.rob_hist;
+	cpu->perf.lsq_hist = fresh.perf.lsq_hist;
+	for(int i=0; i<MAX_CACHE_LEVELS; i++) {
+		cpu->cache.level[i].lines = fresh.cache.level[i].lines;
+		cpu->cache.level[i].plru = fresh.cache.level[i].plru;
+	}
+	cpu->cache.mshr = fresh.cache.mshr;
+	cpu->trace = NULL; // a restored run opens its own
+	cpu->print_info = fresh.print_info;
+	cpu->print_stack = fresh.print_stack;
+	cpu->print_stack_ptr = 0;
+	cpu->ckpt_map = NULL;
+	cpu->ckpt_size = 0;
+}
+
+// batch checkpoints have no display state ; in-flight insn get their static fields, without rename details
+static void fill_print_info(cpu_t* cpu) {
+	for(int i=0; i<cpu->code_size; i++) {
+		stage_t* p = &cpu->print_info[i];
+		const insn_t* insn = &cpu->code[i];
+		p->pc = CODE_START_ADDR + 4 * i;
+		p->opcode = insn->opcode;
+		p->rd = insn->rd;
+		p->rs1 = insn->rs1;
+		p->rs2 = insn->rs2;
+		p->imm = insn->imm;
+	}
+}
+
+cpu_t* cpu_restore(const char* filename, char batch) {
+	int fd = open(filename, O_RDONLY);
+	if(fd < 0) return NULL;
+	struct stat st;
+	if(fstat(fd, &st) || (size_t) st.st_size < sizeof(ckpt_header_t) + sizeof(cpu_t)) {
+		close(fd);
+		return NULL;
+	}
+	// private and writable ; memory pages are copied only once the restored run stores to them
+	size_t size = st.st_size;
+	char* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED) return NULL;
+
+	ckpt_header_t header;
+	memcpy(&header, map, sizeof(header));
+	uint64_t mem_bytes = (uint64_t) header.config.mem_size * sizeof(int);
+	if(memcmp(header.magic, CKPT_MAGIC, 4) || header.version != CKPT_VERSION || header.cpu_size != sizeof(cpu_t) || header.config.mem_size < 0 || header.mem_offset + mem_bytes != size) {
+		munmap(map, size);
+		return NULL;
+	}
+
+	size_t pos = sizeof(header);
+	cpu_t saved;
+	memcpy(&saved, map + pos, sizeof(cpu_t));
+	pos += sizeof(cpu_t);
+
+	// a cpu of the same shape ; code is the first section
+	cpu_t* cpu = NULL;
+	if(header.code_size > 0 && pos + header.code_size * sizeof(insn_t) <= header.mem_offset) {
+		cpu = cpu_init_code((const insn_t*) (map + pos), header.code_size, &header.config, batch);
+	}
+	if(!cpu) {
+		munmap(map, size);
+		return NULL;
+	}
+
+	section_t s[MAX_SECTIONS];
+	restore_scalars(cpu, &saved);
+	int num = cpu_sections(cpu, s);
+	if(mem_offset(&header, s, num) != header.mem_offset) { // the saved predictor or sizes disagree with the config
+		munmap(map, size);
+		cpu_stop(cpu);
+		return NULL;
+	}
+	for(int i=0; i<num; i++) {
+		memcpy(s[i].data, map + pos, s[i].size);
+		pos += s[i].size;
+	}
+	if(!batch && header.print_info) memcpy(cpu->print_info, map + pos, print_info_size(&header));
+	else if(!batch) fill_print_info(cpu);
+
+	// the memory image is used in place when it starts on a page ; otherwise copied like the rest
+	if(header.mem_offset % sysconf(_SC_PAGESIZE) == 0) {
+		free(cpu->memory);
+		cpu->memory = (int*) (map + header.mem_offset);
+		cpu->ckpt_map = map;
+		cpu->ckpt_size = size;
+	} else {
+		memcpy(cpu->memory, map + header.mem_offset, mem_bytes);
+		munmap(map, size);
+	}
+	return cpu;
+}
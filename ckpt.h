@@ -0,0 +1,42 @@
+#ifndef CKPT_H
+#define CKPT_H
+
+#include <stdint.h>
+
+#include "cpu.h"
+
+/*
+
+	Checkpoints ; the whole cpu_t state of a run, restored to continue it later
+
+	file layout:
+		ckpt_header_t
+		cpu_t as it was in memory ; its pointers are meaningless and replaced on restore
+		code, unified_regs, latch slots, rob, iq, lsq, wait lists, FUs, cfids, cfq, saved_state and its registers,
+		branch predictor tables, perf histograms, cache tags and MSHRs ; sizes follow from the config
+		print_info, only if the saving run displayed ; code_size + 1 entries
+		zero padding up to mem_offset
+		memory ; mem_size words, mapped copy-on-write on restore
+
+	the raw struct ties a checkpoint to the simulator build that wrote it ; cpu_size and CKPT_VERSION catch a mismatch
+
+*/
+
+#define CKPT_MAGIC "APXC"
+#define CKPT_VERSION 13
+#define CKPT_ALIGN 4096 // memory image offset ; lets restore map it in place when the page size divides it
+
+typedef struct ckpt_header_t {
+	char magic[4];
+	uint32_t version;
+	uint32_t cpu_size; // sizeof(cpu_t) of the writer
+	int32_t code_size;
+	uint32_t print_info; // 1 if the display bookkeeping is saved
+	uint64_t mem_offset; // memory image, from the start of the file
+	config_t config; // the restored cpu is built with it ; command line parameters do not apply
+} ckpt_header_t;
+
+int cpu_save(const cpu_t* cpu, const char* filename); // 0 on success
+cpu_t* cpu_restore(const char* filename, char batch); // NULL if the file is not a checkpoint of this build
+
+#endif // CKPT_H
@@ -0,0 +1,232 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h> // offsetof
+
+#include "config.h"
+
+typedef struct config_param_t {
+	const char* name;
+	size_t offset;
+	int min; // smallest usable value
+	const char* const* values; // names of an enumerated parameter, indexed by value ; NULL if numeric
+} config_param_t;
+
+static const char* const bpred_names[] = { "none", "static", "bimodal", "gshare", "tage", NULL };
+static const char* const load_names[] = { "inorder", "conservative", "speculative", NULL };
+static const char* const onoff_names[] = { "off", "on", NULL };
+static const char* const repl_names[] = { "lru", "plru", NULL };
+
+static const config_param_t params[] = {
+	{ "num_unified_regs", offsetof(config_t, num_unified_regs), 1 },
+	{ "mem_size", offsetof(config_t, mem_size), 1 },
+	{ "iq_size", offsetof(config_t, iq_size), 1 },
+	{ "rob_size", offsetof(config_t, rob_size), 1 },
+	{ "lsq_size", offsetof(config_t, lsq_size), 1 },
+	{ "cfq_size", offsetof(config_t, cfq_size), 1 },
+	{ "width", offsetof(config_t, width), 1 },
+	{ "max_commit_num", offsetof(config_t, max_commit_num), 1 },
+	{ "num_int_fu", offsetof(config_t, num_int_fu), 1 },
+	{ "num_mul_fu", offsetof(config_t, num_mul_fu), 1 },
+	{ "num_agu", offsetof(config_t, num_agu), 0 },
+	{ "bpred", offsetof(config_t, bpred), 0, bpred_names },
+	{ "bpred_bits", offsetof(config_t, bpred_bits), 4 },
+	{ "btb_size", offsetof(config_t, btb_size), 1 },
+	{ "ras_size", offsetof(config_t, ras_size), 1 },
+	{ "int_fu_lat", offsetof(config_t, int_fu_lat), 1 },
+	{ "mul_fu_lat", offsetof(config_t, mul_fu_lat), 1 },
+	{ "agu_lat", offsetof(config_t, agu_lat), 1 },
+	{ "int_fu_ii", offsetof(config_t, int_fu_ii), 0 },
+	{ "mul_fu_ii", offsetof(config_t, mul_fu_ii), 0 },
+	{ "agu_ii", offsetof(config_t, agu_ii), 0 },
+	{ "mem_fu_lat", offsetof(config_t, mem_fu_lat), 1 },
+	{ "load_issue", offsetof(config_t, load_issue), 0, load_names },
+	{ "load_ports", offsetof(config_t, load_ports), 1 },
+	{ "store_ports", offsetof(config_t, store_ports), 0 },
+	{ "mem_pipelined", offsetof(config_t, mem_pipelined), 0, onoff_names },
+	{ "l1d_size", offsetof(config_t, l1d_size), 0 },
+	{ "l1d_assoc", offsetof(config_t, l1d_assoc), 1 },
+	{ "l1d_line", offsetof(config_t, l1d_line), 1 },
+	{ "l1d_lat", offsetof(config_t, l1d_lat), 1 },
+	{ "l2_size", offsetof(config_t, l2_size), 0 },
+	{ "l2_assoc", offsetof(config_t, l2_assoc), 1 },
+	{ "l2_line", offsetof(config_t, l2_line), 1 },
+	{ "l2_lat", offsetof(config_t, l2_lat), 1 },
+	{ "cache_repl", offsetof(config_t, cache_repl), 0, repl_names },
+	{ "mshrs", offsetof(config_t, mshrs), 1 },
+	{ "mem_lat", offsetof(config_t, mem_lat), 1 },
+};
+#define NUM_PARAMS (sizeof(params) / sizeof(params[0]))
+
+void config_default(config_t* config) {
+	config->num_unified_regs = 40;
+	config->mem_size = 4000;
+
+	config->iq_size = 16;
+	config->rob_size = 32;
+	config->lsq_size = 20;
+	config->cfq_size = 8;
+
+	config->width = 1;
+	config->max_commit_num = 2;
+
+	config->num_int_fu = 1;
+	config->num_mul_fu = 1;
+	config->num_agu = 0; // intFU computes addresses and resolves branches
+
+	config->bpred = BPRED_NONE; // always fetch pc+4
+	config->bpred_bits = 10;
+	config->btb_size = 64;
+	config->ras_size = 8;
+
+	config->int_fu_lat = 1;
+	config->mul_fu_lat = 2;
+	config->agu_lat = 1;
+	config->int_fu_ii = 0; // not pipelined
+	config->mul_fu_ii = 0;
+	config->agu_ii = 0;
+	config->mem_fu_lat = 3;
+	config->load_issue = LOAD_INORDER;
+	config->load_ports = 1;
+	config->store_ports = 0; // STOREs share the load port
+	config->mem_pipelined = 0;
+
+	config->l1d_size = 0; // flat mem_fu_lat
+	config->l1d_assoc = 2;
+	config->l1d_line = 4;
+	config->l1d_lat = 1;
+	config->l2_size = 0;
+	config->l2_assoc = 4;
+	config->l2_line = 8;
+	config->l2_lat = 6;
+	config->cache_repl = CACHE_REPL_LRU;
+	config->mshrs = 4;
+	config->mem_lat = 30;
+}
+
+// keys may be spelled with '-' instead of '_' (ex, rob-size from the command line)
+static int key_matches(const char* key, const char* name) {
+	for(; *key && *name; key++, name++) {
+		char c = (*key == '-') ? '_' : *key;
+		if(c != *name) return 0;
+	}
+	return *key == *name;
+}
+
+static const config_param_t* find_param(const char* key) {
+	for(size_t i=0; i<NUM_PARAMS; i++) {
+		if(key_matches(key, params[i].name)) return &params[i];
+	}
+	return NULL;
+}
+
+int config_value(const char* key, const char* value, int* v) {
+	const config_param_t* param = find_param(key);
+	if(!param) return -1;
+
+	const char* const* values = param->values;
+	for(int n=0; values && values[n]; n++) {
+		if(strcmp(value, values[n]) == 0) {
+			*v = n;
+			return 0;
+		}
+	}
+
+	char* end;
+	long n = strtol(value, &end, 0);
+	if(end == value || *end != '\0' || n < param->min) return -1;
+	for(long i=0; values && i<=n; i++) {
+		if(!values[i]) return -1; // past the last name
+	}
+	*v = (int) n;
+	return 0;
+}
+
+const char* config_value_name(const char* key, int v) {
+	const config_param_t* param = find_param(key);
+	if(!param || !param->values) return NULL;
+	return param->values[v];
+}
+
+int config_set(config_t* config, const char* key, const char* value) {
+	int v;
+	if(config_value(key, value, &v)) return -1;
+	*(int*) ((char*) config + find_param(key)->offset) = v;
+	return 0;
+}
+
+int config_load(config_t* config, const char* filename) {
+	FILE* fd = fopen(filename, "r");
+	if(!fd) {
+		fprintf(stderr, "config> Could not open %s\n", filename);
+		return -1;
+	}
+
+	char* line = NULL;
+	size_t len = 0;
+	int line_num = 0;
+	int ret = 0;
+	while(getline(&line, &len, fd) != -1) {
+		line_num++;
+		line[strcspn(line, "#\r\n")] = 0; // strip comments and new line
+
+		char key[128];
+		char value[128];
+		int n = sscanf(line, " %127[^= \t] = %127s", key, value);
+		if(n <= 0) continue; // blank line
+		if(n != 2 || config_set(config, key, value)) {
+			fprintf(stderr, "config> %s:%d: invalid setting '%s'\n", filename, line_num, line);
+			ret = -1;
+		}
+	}
+
+	free(line);
+	fclose(fd);
+	return ret;
+}
+
+int config_check(const config_t* config) {
+	for(size_t i=0; i<NUM_PARAMS; i++) {
+		int v = *(const int*) ((const char*) config + params[i].offset);
+		if(v < params[i].min) {
+			fprintf(stderr, "config> %s must be at least %d\n", params[i].name, params[i].min);
+			return -1;
+		}
+		for(int n=0; params[i].values && n<=v; n++) {
+			if(!params[i].values[n]) {
+				fprintf(stderr, "config> %s has no value %d\n", params[i].name, v);
+				return -1;
+			}
+		}
+	}
+
+	if(config->mem_size > MAX_MEM_SIZE) {
+		fprintf(stderr, "config> mem_size must be at most %d\n", MAX_MEM_SIZE);
+		return -1;
+	}
+
+	// every set gets the same number of whole lines
+	const char* names[] = { "l1d", "l2" };
+	int size[] = { config->l1d_size, config->l2_size };
+	int assoc[] = { config->l1d_assoc, config->l2_assoc };
+	int line[] = { config->l1d_line, config->l2_line };
+	for(int i=0; i<2 && size[0]; i++) {
+		if(size[i] && size[i] % (assoc[i] * line[i])) {
+			fprintf(stderr, "config> %s_size must be a multiple of %s_assoc * %s_line\n", names[i], names[i], names[i]);
+			return -1;
+		}
+		if(size[i] && config->cache_repl == CACHE_REPL_PLRU && (assoc[i] & (assoc[i] - 1))) {
+			fprintf(stderr, "config> plru needs a power-of-two %s_assoc\n", names[i]);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+void config_print(const config_t* config) {
+	for(size_t i=0; i<NUM_PARAMS; i++) {
+		int v = *(const int*) ((const char*) config + params[i].offset);
+		if(params[i].values) printf("%-18s %s\n", params[i].name, params[i].values[v]);
+		else printf("%-18s %d\n", params[i].name, v);
+	}
+}
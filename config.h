@@ -0,0 +1,77 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+/*
+
+	Machine parameters ; set at runtime from a config file or command-line flags
+
+*/
+
+#define MAX_MEM_SIZE (1 << 24) // largest mem_size, in words ; .data addresses stay below it
+
+typedef struct config_t {
+	int num_unified_regs;
+	int mem_size; // data memory, in words
+
+	int iq_size; // max entries of instruction queue
+	int rob_size; // max entries of reorder buffer
+	int lsq_size; // max entries in load-store queue
+	int cfq_size; // max control-flow insn in flight
+
+	int width; // insn fetched, decoded and dispatched per cycle
+	int max_commit_num; // max number of instructions that can commit
+
+	int num_int_fu; // intFU instances ; issue sends at most one insn to each free FU
+	int num_mul_fu;
+	int num_agu; // address and branch units ; 0 leaves that work on intFU
+
+	int bpred; // direction predictor ; one of BPRED_* below
+	int bpred_bits; // log2 of the predictor table entries
+	int btb_size; // branch target buffer entries
+	int ras_size; // return-address stack entries
+
+	int int_fu_lat;
+	int mul_fu_lat;
+	int agu_lat;
+	int int_fu_ii; // cycles before a unit takes its next insn ; 0 for the latency, not pipelined
+	int mul_fu_ii;
+	int agu_ii;
+	int mem_fu_lat; // every LOAD and STORE when the caches are off
+	int load_issue; // when a LOAD may access memory ; one of LOAD_* below
+	int load_ports; // memFU accesses that can start per cycle ; STOREs use these too unless store_ports is set
+	int store_ports; // ports only for STOREs
+	int mem_pipelined; // 0 : a port holds one access until it completes ; 1 : a port starts a new one every cycle
+
+	// data caches ; sizes in words, l1d_size 0 turns them off and l2_size 0 leaves L2 out
+	int l1d_size;
+	int l1d_assoc;
+	int l1d_line;
+	int l1d_lat;
+	int l2_size;
+	int l2_assoc;
+	int l2_line;
+	int l2_lat;
+	int cache_repl; // one of CACHE_REPL_* below
+	int mshrs; // L1D misses in flight
+	int mem_lat; // behind the last cache level
+} config_t;
+
+// branch predictors ; names are accepted wherever a value is (bpred = gshare)
+enum { BPRED_NONE, BPRED_STATIC, BPRED_BIMODAL, BPRED_GSHARE, BPRED_TAGE, NUM_BPREDS };
+
+// LOAD scheduling ; INORDER waits for the ROB head, the others go as soon as the address is known
+// CONSERVATIVE also waits for every older STORE address, SPECULATIVE goes past unknown ones and is flushed if it guessed wrong
+enum { LOAD_INORDER, LOAD_CONSERVATIVE, LOAD_SPECULATIVE, NUM_LOAD_ISSUES };
+
+// cache replacement ; PLRU is a binary tree per set and needs a power-of-two associativity
+enum { CACHE_REPL_LRU, CACHE_REPL_PLRU, NUM_CACHE_REPLS };
+
+void config_default(config_t* config);
+int config_set(config_t* config, const char* key, const char* value); // 0 on success, -1 if unknown key or bad value
+int config_value(const char* key, const char* value, int* v); // what config_set() would store ; -1 if unknown key or bad value
+const char* config_value_name(const char* key, int v); // name of value v of an enumerated parameter ; NULL if numeric
+int config_load(config_t* config, const char* filename); // "key = value" per line, '#' starts a comment
+int config_check(const config_t* config); // 0 if every parameter is usable
+void config_print(const config_t* config);
+
+#endif // CONFIG_H
@@ -1,84 +1,250 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <limits.h> // INT_MAX
 #include <assert.h>
+#include <limits.h> // INT_MAX
+#include <sys/mman.h> // munmap()
 
 #include "cpu.h"
 #include "print.h" // all printing functions
+#include "tagmatch.h"
 
 #define PRINT 0
-static char display_cycle = 0; // prints state of each cycle
 
-cpu_t* cpu_init(const char* filename) {
-	
-	if(!filename) return NULL;
+// accesses one memFU port can have in flight ; a pipelined port starts one every cycle and keeps each for up to the longest latency
+static int mem_depth(const config_t* config) {
+	if(!config->mem_pipelined) return 1;
+	if(!config->l1d_size) return config->mem_fu_lat;
+	return config->l1d_lat + (config->l2_size ? config->l2_lat : 0) + config->mem_lat; // a miss all the way to memory
+}
+
+// builds a cpu that fetches straight from prog->code ; with own, the cpu takes prog and frees it in cpu_stop(), otherwise prog must outlive the cpu
+static cpu_t* cpu_create(program_t* prog, char own, const config_t* config, char batch) {
 	
-	cpu_t* cpu = malloc(sizeof(cpu_t));
-	if(!cpu) return NULL;
+	cpu_t* cpu = config_check(config) ? NULL : calloc(1, sizeof(cpu_t));
+	if(!cpu) {
+		if(own) program_free(prog);
+		return NULL;
+	}
+	if(own) cpu->program = *prog;
+	cpu->config = *config;
+	cpu->code = prog->code;
+	cpu->code_size = prog->code_size;
+
+	// every queue and register file is sized by the configuration
+	int num_wait_nodes = config->iq_size * NUM_IQ_WAITS + config->lsq_size;
+	cpu->memory = calloc(config->mem_size, sizeof(int));
+	cpu->unified_regs = calloc(config->num_unified_regs, sizeof(ureg_t));
+	cpu->free_regs = malloc(config->num_unified_regs * sizeof(int));
+	cpu->rob.entries = calloc(config->rob_size, sizeof(rob_entry_t));
+	cpu->rob.taken = calloc(bitmap_words(config->rob_size), sizeof(uint64_t));
+	cpu->rob.cfid = malloc(config->rob_size * sizeof(int));
+	cpu->iq = calloc(config->iq_size, sizeof(iq_entry_t));
+	cpu->iq_cfid = malloc(config->iq_size * sizeof(int));
+	cpu->lsq.entries = calloc(config->lsq_size, sizeof(lsq_entry_t));
+	cpu->lsq.taken = calloc(bitmap_words(config->lsq_size), sizeof(uint64_t));
+	cpu->lsq.cfid = malloc(config->lsq_size * sizeof(int));
+	int max_queue = config->rob_size > config->iq_size ? config->rob_size : config->iq_size;
+	if(config->lsq_size > max_queue) max_queue = config->lsq_size;
+	cpu->tag_mask = malloc(bitmap_words(max_queue) * sizeof(uint64_t));
+	cpu->rob.brmask = calloc((size_t) config->cfq_size * bitmap_words(config->rob_size), sizeof(uint64_t));
+	cpu->iq_ready = calloc((size_t) NUM_FU_TYPES * bitmap_words(config->iq_size), sizeof(uint64_t));
+	cpu->iq_age = calloc((size_t) config->iq_size * bitmap_words(config->iq_size), sizeof(uint64_t));
+	cpu->iq_brmask = calloc((size_t) config->cfq_size * bitmap_words(config->iq_size), sizeof(uint64_t));
+	cpu->lsq.brmask = calloc((size_t) config->cfq_size * bitmap_words(config->lsq_size), sizeof(uint64_t));
+	cpu->unresolved = calloc(bitmap_words(config->cfq_size), sizeof(uint64_t));
+	cpu->wait_head = malloc(config->num_unified_regs * sizeof(int));
+	cpu->wait_nodes = malloc(num_wait_nodes * sizeof(wait_node_t));
+	cpu->iq_free = calloc(bitmap_words(config->iq_size), sizeof(uint64_t));
+	cpu->cfid_free = calloc(bitmap_words(config->cfq_size), sizeof(uint64_t));
+	cpu->cfq = calloc(config->cfq_size, sizeof(int));
+	cpu->saved_state = calloc(config->cfq_size, sizeof(saved_state_t));
+	stage_t* slots = calloc(3 * config->width, sizeof(stage_t)); // F, DRF and DP latches
+	for(int i=F; i<=DP; i++) {
+		if(slots) cpu->stage[i].slots = &slots[(i - F) * config->width];
+	}
+	int units[NUM_FU_TYPES] = { config->num_int_fu, config->num_mul_fu, config->num_agu };
+	int lat[NUM_FU_TYPES] = { config->int_fu_lat, config->mul_fu_lat, config->agu_lat };
+	int ii[NUM_FU_TYPES] = { config->int_fu_ii, config->mul_fu_ii, config->agu_ii };
+	char fu_failed = 0;
+	for(int t=0; t<NUM_FU_TYPES; t++) {
+		fu_pool_t* pool = &cpu->fu[t];
+		pool->units = units[t];
+		pool->lat = lat[t];
+		pool->ii = ii[t] ? ii[t] : lat[t];
+		pool->depth = (pool->lat + pool->ii - 1) / pool->ii;
+		pool->slots = calloc(pool->units * pool->depth, sizeof(fu_t));
+		if(pool->units && !pool->slots) fu_failed = 1;
+	}
+	cpu->mem_ports = config->load_ports + config->store_ports;
+	cpu->mem_slots = cpu->mem_ports * mem_depth(config);
+	cpu->memFU = calloc(cpu->mem_slots, sizeof(fu_t));
+	int bpred_failed = bpred_init(&cpu->bpred, config);
+	int perf_failed = perf_init(&cpu->perf, config);
+	int cache_failed = cache_init(&cpu->cache, config);
+	if(bpred_failed || perf_failed || cache_failed || !cpu->memory || !cpu->unified_regs || !cpu->free_regs || !cpu->rob.entries || !cpu->rob.taken || !cpu->rob.cfid || !cpu->iq || !cpu->iq_free || !cpu->iq_cfid || !cpu->iq_ready || !cpu->iq_age || !cpu->lsq.entries || !cpu->lsq.taken || !cpu->lsq.cfid || !cpu->tag_mask || !cpu->rob.brmask || !cpu->iq_brmask || !cpu->lsq.brmask || !cpu->unresolved || !cpu->wait_head || !cpu->wait_nodes || !cpu->cfid_free || !cpu->cfq || !cpu->saved_state || !slots || fu_failed || !cpu->memFU) {
+		cpu_stop(cpu);
+		return NULL;
+	}
 
 	cpu->clock = 0;	
+	cpu->stop_cycle = 0;
+	cpu->stop_insn = 0;
+	cpu->done = 0;
+	cpu->fault = 0;
+	cpu->batch = batch;
+	cpu->display_cycle = 0;
+	cpu->committed = 0;
+	cpu->events = 0;
 	cpu->pc = CODE_START_ADDR;
 	memset(cpu->arch_regs, -1, sizeof(areg_t) * NUM_ARCH_REGS);
-	memset(cpu->unified_regs, 0, sizeof(ureg_t) * NUM_UNIFIED_REGS);
-	for(int i=0; i<NUM_UNIFIED_REGS; i++) {
+	for(int i=0; i<config->num_unified_regs; i++) {
 		cpu->unified_regs[i].valid = 1;
 	}		
+	ureg_rebuild_free_list(cpu);
 	
 	memset(cpu->front_rename_table, -1, (NUM_ARCH_REGS+1) * sizeof(int)); // +1 for zero-flag
 	memset(cpu->back_rename_table, -1, (NUM_ARCH_REGS+1) * sizeof(int));	
 
-	memset(&cpu->rob, 0, sizeof(rob_t));	
-	memset(cpu->iq, 0, sizeof(iq_entry_t));	
-	memset(&cpu->lsq, 0, sizeof(lsq_t));	
+	cpu->rob.size = config->rob_size;
+	cpu->lsq.size = config->lsq_size;
+	memset(cpu->rob.cfid, -1, config->rob_size * sizeof(int));
+	memset(cpu->iq_cfid, -1, config->iq_size * sizeof(int));
+	memset(cpu->lsq.cfid, -1, config->lsq_size * sizeof(int));
+
+	memset(cpu->wait_head, -1, sizeof(int) * config->num_unified_regs);
+	for(int i=0; i<num_wait_nodes; i++) {
+		cpu->wait_nodes[i].reg = -1;
+	}
 
-	memset(cpu->stage, 0, sizeof(stage_t) * NUM_STAGES);
-	memset(cpu->memory, 0, sizeof(int) * MEM_SIZE);
-		
 	cpu->cfid = -1;
-	memset(cpu->cfid_freelist, 0, CFQ_SIZE);
 	cpu->cfq_head_ptr = 0;
 	cpu->cfq_tail_ptr = 0;
+	cpu->cfq_num = 0;
+	bitmap_fill(cpu->iq_free, config->iq_size);
+	bitmap_fill(cpu->cfid_free, config->cfq_size);
 	
-	// obtain instructions from .asm file	
-	cpu->code = create_code(filename, &cpu->code_size);
-	
-	if(!cpu->code) {
-		free(cpu);
-		return NULL;
-	}
+	// solely for printing purposes ; batch runs keep no print bookkeeping
+	cpu->print_info = NULL;
+	cpu->print_stack = NULL;
+	cpu->print_stack_ptr = 0;
+	if(!batch) {
+		// every front-end slot and FU, the commits, and each memFU port with the STORE it committed
+		int print_stack_size = 3 * config->width + config->num_int_fu + config->num_mul_fu + config->num_agu + config->max_commit_num + 2 * cpu->mem_ports;
+		cpu->print_stack = malloc(print_stack_size * sizeof(print_info_t));
+		if(!cpu->print_stack) {
+			cpu_stop(cpu);
+			return NULL;
+		}
 
-	// prints the instructions that we loaded from file		
-	print_code(cpu);
+		// prints the instructions that we loaded from file		
+		print_code(cpu);
 	
-	// solely for printing purposes
-	cpu->print_info = (stage_t*) malloc((cpu->code_size + 1) * sizeof(stage_t)); // information about each instruction ; +1 for NOP
-	memset(cpu->print_info, 0,(cpu->code_size + 1) * sizeof(stage_t));
-	for(int i=0; i<cpu->code_size + 1; i++) {
-		stage_t* nop = &cpu->print_info[i];	
-		strcpy(nop->opcode, "NOP");
-		nop->pc = 0;
-		nop->cfid = -1;
+		cpu->print_info = (stage_t*) malloc((cpu->code_size + 1) * sizeof(stage_t)); // information about each instruction ; +1 for NOP
+		memset(cpu->print_info, 0,(cpu->code_size + 1) * sizeof(stage_t));
+		for(int i=0; i<cpu->code_size + 1; i++) {
+			stage_t* nop = &cpu->print_info[i];	
+			nop->opcode = OP_NOP;
+			nop->pc = 0;
+			nop->cfid = -1;
+		}
 	}
 	
-	cpu->intFU.busy = 0;
-	cpu->intFU.print_idx = cpu->code_size;
-	
-	cpu->mulFU.busy = 0;
-	cpu->mulFU.print_idx = cpu->code_size;
-	
-	cpu->memFU.busy = 0;
-	cpu->memFU.print_idx = cpu->code_size;
+	for(int t=0; t<NUM_FU_TYPES; t++) {
+		fu_pool_t* pool = &cpu->fu[t];
+		for(int i=0; i<pool->units * pool->depth; i++) {
+			pool->slots[i].busy = 0;
+			pool->slots[i].print_idx = cpu->code_size;
+		}
+	}
 	
-	for(int i=1; i<NUM_STAGES; i++) {
-		cpu->stage[i].stalled = 1;
+	for(int i=0; i<cpu->mem_slots; i++) {
+		cpu->memFU[i].busy = 0;
+		cpu->memFU[i].print_idx = cpu->code_size;
 	}
 	
+	// Decode and Dispatch start empty, not stalled ; decode only stalls on an invalid insn or a HALT, which keeps fetch from passing it another group
 	return cpu;
 }
 
+// code is shared with prog ; .data is copied, since memory is mem_size words of this cpu's own and the program only has data_size
+static cpu_t* cpu_from_program(program_t* prog, char own, const config_t* config, char batch) {
+	if(prog->code_size <= 0 || prog->data_size > config->mem_size) {
+		if(prog->code_size > 0) fprintf(stderr, "sim> .data reaches address %d but mem_size is %d\n", prog->data_size - 1, config->mem_size);
+		if(own) program_free(prog);
+		return NULL;
+	}
+	int* data = prog->data;
+	int data_size = prog->data_size;
+	cpu_t* cpu = cpu_create(prog, own, config, batch);
+	if(cpu && data_size) memcpy(cpu->memory, data, data_size * sizeof(int));
+	return cpu;
+}
+
+cpu_t* cpu_init(const char* filename, const config_t* config, char batch) {
+	if(!filename || !config) return NULL;
+
+	// obtain instructions from .asm file or a program image ; the cpu keeps the program, a mapped image is fetched from in place
+	program_t prog;
+	if(program_load(filename, &prog)) return NULL;
+	return cpu_from_program(&prog, 1, config, batch);
+}
+
+// every cpu gets its own copy ; for code whose buffer goes away, a checkpoint mapping for one
+cpu_t* cpu_init_code(const insn_t* code, int code_size, const config_t* config, char batch) {
+	if(!code || code_size <= 0 || !config) return NULL;
+
+	program_t prog = { 0 };
+	prog.code = malloc(code_size * sizeof(insn_t));
+	if(!prog.code) return NULL;
+	memcpy(prog.code, code, code_size * sizeof(insn_t));
+	prog.code_size = code_size;
+	return cpu_create(&prog, 1, config, batch);
+}
+
+cpu_t* cpu_init_program(const program_t* prog, const config_t* config, char batch) {
+	if(!prog || !config) return NULL;
+	return cpu_from_program((program_t*) prog, 0, config, batch); // only read
+}
+
 void cpu_stop(cpu_t* cpu) {
-	free(cpu->code);
+	free(cpu->print_stack);
+	free(cpu->print_info);
+	program_free(&cpu->program); // code, unless it belongs to the caller
+
+	free(cpu->saved_state);
+	bpred_free(&cpu->bpred);
+	perf_free(&cpu->perf);
+	cache_free(&cpu->cache);
+	free(cpu->cfq);
+	free(cpu->cfid_free);
+	free(cpu->memFU);
+	for(int t=0; t<NUM_FU_TYPES; t++) {
+		free(cpu->fu[t].slots);
+	}
+	free(cpu->stage[F].slots); // one block for every latch
+	free(cpu->wait_nodes);
+	free(cpu->wait_head);
+	free(cpu->unresolved);
+	free(cpu->lsq.brmask);
+	free(cpu->iq_brmask);
+	free(cpu->rob.brmask);
+	free(cpu->tag_mask);
+	free(cpu->lsq.cfid);
+	free(cpu->lsq.taken);
+	free(cpu->lsq.entries);
+	free(cpu->iq_age);
+	free(cpu->iq_ready);
+	free(cpu->iq_cfid);
+	free(cpu->iq_free);
+	free(cpu->iq);
+	free(cpu->rob.cfid);
+	free(cpu->rob.taken);
+	free(cpu->rob.entries);
+	free(cpu->free_regs);
+	free(cpu->unified_regs);
+	if(cpu->ckpt_map) munmap(cpu->ckpt_map, cpu->ckpt_size); // memory is part of the mapping
+	else free(cpu->memory);
 	free(cpu);
 }
 
@@ -86,925 +252,1399 @@ int get_code_index(int pc) {
 	return (pc - CODE_START_ADDR) / 4;
 }
 
-char is_controlflow(char* opcode) {
-	if( strcmp(opcode, "BZ") 	== 0 ||
-		strcmp(opcode, "BNZ") 	== 0 ||
-		strcmp(opcode, "JUMP") 	== 0 ||
-		strcmp(opcode, "JAL") 	== 0 ){
-		return 1;
+char is_controlflow(opcode_t opcode) {
+	return (opcode_props[opcode] & OPP_CF) != 0;
+}
+
+// how the predictor treats a control-flow insn ; JAL is a call, JUMP usually a return
+static int branch_kind(opcode_t opcode) {
+	if(opcode == OP_JAL) return BR_CALL;
+	if(opcode == OP_JUMP) return BR_INDIRECT;
+	return BR_COND;
+}
+
+char is_halt(opcode_t opcode) {
+	return opcode == OP_HALT;
+}
+
+char is_nop(opcode_t opcode) {
+	return opcode == OP_NOP;
+}
+
+// ALU insn, plus address calculation for LOAD/STORE and branch decision for BZ/BNZ/JUMP/JAL
+char is_intFU(opcode_t opcode) {
+	return (opcode_props[opcode] & OPP_INTFU) != 0;
+}
+
+char is_mem(opcode_t opcode) {
+	return (opcode_props[opcode] & OPP_MEM) != 0;
+}
+
+// checks if this insn writes to a register
+char has_rd(opcode_t opcode) {
+	return (opcode_props[opcode] & OPP_RD) != 0;
+}
+
+// checks if this insn becomes the most recent zero-flag producer
+char sets_zero_flag(opcode_t opcode) {
+	return (opcode_props[opcode] & OPP_ZF) != 0;
+}
+
+// BZ and BNZ wait on the zero-flag
+char reads_zero_flag(opcode_t opcode) {
+	return (opcode_props[opcode] & OPP_READS_ZF) != 0;
+}
+
+char is_valid_insn(opcode_t opcode) {
+	return (opcode_props[opcode] & OPP_VALID) != 0;
+}
+
+// counter class of a committed insn
+static int insn_class(opcode_t opcode) {
+	if(is_halt(opcode)) return CLS_HALT;
+	if(is_controlflow(opcode)) return CLS_BRANCH;
+	if(opcode == OP_LOAD) return CLS_LOAD;
+	if(opcode == OP_STORE) return CLS_STORE;
+	if(opcode_props[opcode] & OPP_MULFU) return CLS_MUL;
+	return CLS_ALU;
+}
+
+/*
+
+	Wakeup and select
+
+*/
+
+// link an operand into the consumer list of unified register reg
+static void wait_add(cpu_t* cpu, int node, int reg) {
+	wait_node_t* n = &cpu->wait_nodes[node];
+	n->reg = reg;
+	n->prev = -1;
+	n->next = cpu->wait_head[reg];
+	if(n->next != -1) cpu->wait_nodes[n->next].prev = node;
+	cpu->wait_head[reg] = node;
+}
+
+static void wait_remove(cpu_t* cpu, int node) {
+	wait_node_t* n = &cpu->wait_nodes[node];
+	if(n->reg == -1) return; // not waiting
+	if(n->prev != -1) cpu->wait_nodes[n->prev].next = n->next;
+	else cpu->wait_head[n->reg] = n->next;
+	if(n->next != -1) cpu->wait_nodes[n->next].prev = n->prev;
+	n->reg = -1;
+}
+
+static int lsq_wait_node(cpu_t* cpu, int lsq_idx) {
+	return cpu->config.iq_size * NUM_IQ_WAITS + lsq_idx;
+}
+
+static int fu_type(cpu_t* cpu, opcode_t opcode) {
+	if(opcode_props[opcode] & OPP_MULFU) return FU_MUL;
+	if(cpu->config.num_agu && (opcode_props[opcode] & (OPP_MEM | OPP_CF))) return FU_AGU;
+	return FU_INT;
+}
+
+// all operands this insn needs before it can leave the IQ
+static char iq_entry_ready(iq_entry_t* iqe) {
+	if(is_mem(iqe->opcode)) return iqe->u_rs1_ready; // mem insn only need rs1 to compute the address
+	char ready = iqe->u_rs1_ready && iqe->u_rs2_ready;
+	if(reads_zero_flag(iqe->opcode)) ready = ready && iqe->zero_flag_ready; // for these insn, zero-flag value must also be ready
+	return ready;
+}
+
+// ready set of FU type t ; bit i set while IQ entry i has its operands and waits for a unit of that type
+static uint64_t* ready_set(cpu_t* cpu, int t) {
+	return &cpu->iq_ready[t * bitmap_words(cpu->config.iq_size)];
+}
+
+static void ready_insert(cpu_t* cpu, int iq_idx) {
+	bitmap_set(ready_set(cpu, fu_type(cpu, cpu->iq[iq_idx].opcode)), iq_idx);
+}
+
+static void ready_remove(cpu_t* cpu, int iq_idx) {
+	bitmap_clear(ready_set(cpu, fu_type(cpu, cpu->iq[iq_idx].opcode)), iq_idx);
+}
+
+// age matrix row of an IQ entry ; bit j set if entry j was dispatched before it
+static uint64_t* age_row(cpu_t* cpu, int iq_idx) {
+	return &cpu->iq_age[(size_t) iq_idx * bitmap_words(cpu->config.iq_size)];
+}
+
+// a new entry is younger than everything in the IQ ; its column goes, the last insn in this slot may have been older than some
+static void age_insert(cpu_t* cpu, int iq_idx) {
+	int iq_size = cpu->config.iq_size;
+	int words = bitmap_words(iq_size);
+	uint64_t* row = age_row(cpu, iq_idx);
+	for(int w=0; w<words; w++) {
+		row[w] = ~cpu->iq_free[w]; // entries in use ; its own bit is still free
+	}
+	// rows of free entries are rewritten when they are taken, so only the ones in use need the bit cleared
+	uint64_t* column = &cpu->iq_age[iq_idx / 64];
+	uint64_t keep = ~((uint64_t) 1 << (iq_idx % 64));
+	for(int w=0; w<words; w++) {
+		for(uint64_t used = row[w]; used; used &= used - 1) {
+			int i = w * 64 + __builtin_ctzll(used);
+			if(i >= iq_size) break; // past the last entry ; iq_free never has those bits set
+			column[(size_t) i * words] &= keep;
+		}
+	}
+}
+
+// oldest entry of set ; the one with no older entry in it, a priority encoder over set & older ; -1 if set is empty
+static int age_select(cpu_t* cpu, const uint64_t* set) {
+	int iq_size = cpu->config.iq_size;
+	for(int i=bitmap_first(set, iq_size); i!=-1; i=bitmap_next(set, iq_size, i+1)) {
+		const uint64_t* older = age_row(cpu, i);
+		int w = 0;
+		while(w < bitmap_words(iq_size) && !(older[w] & set[w])) w++;
+		if(w == bitmap_words(iq_size)) return i;
+	}
+	return -1;
+}
+
+// free an IQ entry and drop it from every list it is linked into
+static void iq_release(cpu_t* cpu, int iq_idx) {
+	bitmap_set(cpu->iq_free, iq_idx);
+	cpu->iq_num--;
+	for(int w=0; w<NUM_IQ_WAITS; w++) {
+		wait_remove(cpu, iq_idx * NUM_IQ_WAITS + w);
 	}
-	else return 0;
+	ready_remove(cpu, iq_idx);
+}
+
+/*
+
+	Unified register free list
+
+*/
+
+// free_head and free_tail wrap at twice the list size ; the slot is the position modulo the size
+static int free_next(cpu_t* cpu, int ptr) {
+	return (ptr + 1) % (2 * cpu->config.num_unified_regs);
 }
 
-char is_halt(char* opcode) {
-	return strcmp(opcode, "HALT") == 0;
+static int free_unified_regs(cpu_t* cpu) {
+	int n = cpu->config.num_unified_regs;
+	return (cpu->free_tail - cpu->free_head + 2 * n) % (2 * n);
 }
 
-char is_nop(char* opcode) {
-	return strcmp(opcode, "NOP") == 0;
+// the caller checked free_unified_regs()
+static int ureg_alloc(cpu_t* cpu) {
+	int u = cpu->free_regs[cpu->free_head % cpu->config.num_unified_regs];
+	cpu->free_head = free_next(cpu, cpu->free_head);
+	ureg_t* r = &cpu->unified_regs[u];
+	r->taken = 1;
+	r->valid = 0;
+	r->zero_flag = 0;
+	return u;
 }
 
-char is_intFU(char* opcode) {
-	if( strcmp(opcode, "ADD") 	== 0 ||
-		strcmp(opcode, "SUB") 	== 0 ||
-		strcmp(opcode, "AND") 	== 0 ||
-		strcmp(opcode, "OR") 	== 0 ||
-		strcmp(opcode, "XOR")   == 0 ||
-		strcmp(opcode, "MOVC") 	== 0 ||
-		strcmp(opcode, "ADDL") 	== 0 ||
-		strcmp(opcode, "SUBL") 	== 0 ||
-		strcmp(opcode, "LOAD") 	== 0 || // addr calculation
-		strcmp(opcode, "STORE") == 0 || // addr calculation
-		strcmp(opcode, "BZ") 	== 0 || // addr calculation and branch decision
-		strcmp(opcode, "BNZ") 	== 0 || // addr calculation and branch decision
-		strcmp(opcode, "JUMP") 	== 0 || // addr calculation ; branch always taken
-		strcmp(opcode, "JAL") 	== 0 ){ // addr calculation ; branch always taken
+static void ureg_release(cpu_t* cpu, int u) {
+	cpu->unified_regs[u].taken = 0;
+	cpu->free_regs[cpu->free_tail % cpu->config.num_unified_regs] = u;
+	cpu->free_tail = free_next(cpu, cpu->free_tail);
+}
 
-		return 1;
+// a flushed branch ; every register handed out since it was renamed is free again, in the same order
+static void ureg_rewind(cpu_t* cpu, int free_head) {
+	for(int p=free_head; p!=cpu->free_head; p=free_next(cpu, p)) {
+		cpu->unified_regs[cpu->free_regs[p % cpu->config.num_unified_regs]].taken = 0;
 	}
-	else return 0;
+	cpu->free_head = free_head;
 }
 
-char is_mem(char* opcode) {
-	if( strcmp(opcode, "LOAD") == 0 || strcmp(opcode, "STORE") == 0 ) return 1;
-	else return 0;
+void ureg_rebuild_free_list(cpu_t* cpu) {
+	cpu->free_head = 0;
+	cpu->free_tail = 0;
+	for(int i=0; i<cpu->config.num_unified_regs; i++) {
+		if(!cpu->unified_regs[i].taken) ureg_release(cpu, i);
+	}
 }
 
-// checks if this insn writes to a register
-char has_rd(char* opcode) {
-	if( strcmp(opcode, "ADD") 	== 0 ||
-		strcmp(opcode, "SUB") 	== 0 ||
-		strcmp(opcode, "AND") 	== 0 ||
-		strcmp(opcode, "OR") 	== 0 ||
-		strcmp(opcode, "XOR")   == 0 ||
-		strcmp(opcode, "MUL") 	== 0 ||
-		strcmp(opcode, "MOVC") 	== 0 ||
-		strcmp(opcode, "LOAD") 	== 0 ||
-		strcmp(opcode, "ADDL") 	== 0 ||
-		strcmp(opcode, "SUBL") 	== 0 ||	
-		strcmp(opcode, "JAL") 	== 0 ){	 // saves return address to a register value, which another JUMP insn would use to return
-		return 1;
-	}
-	else return 0;
-}
-
-char is_valid_insn(char* opcode) {
-	if( strcmp(opcode, "ADD") 	== 0 ||
-		strcmp(opcode, "SUB") 	== 0 ||
-		strcmp(opcode, "AND") 	== 0 ||
-		strcmp(opcode, "OR") 	== 0 ||
-		strcmp(opcode, "XOR")   == 0 ||
-		strcmp(opcode, "MUL") 	== 0 ||
-		strcmp(opcode, "MOVC")  == 0 ||
-		strcmp(opcode, "LOAD")  == 0 ||
-		strcmp(opcode, "STORE") == 0 ||
-		strcmp(opcode, "BZ")    == 0 ||
-		strcmp(opcode, "BNZ")   == 0 ||
-		strcmp(opcode, "JUMP")  == 0 ||
-		strcmp(opcode, "NOP")  	== 0 ||
-		strcmp(opcode, "HALT")  == 0 ||
-		// new insn
-		strcmp(opcode, "ADDL")  == 0 ||
-		strcmp(opcode, "SUBL")  == 0 ||
-		strcmp(opcode, "JAL")   == 0 ){
-		return 1;
-	}	
-	
+// the committed zero-flag keeps its register until a younger one commits, even after its arch reg was overwritten
+static char ureg_committed(cpu_t* cpu, int u) {
+	for(int i=0; i<NUM_ARCH_REGS+1; i++) { // +1 for zero-flag
+		if(cpu->back_rename_table[i] == u) return 1;
+	}
 	return 0;
 }
 
-int fetch(cpu_t* cpu) {
-	
-	stage_t* stage = &cpu->stage[F];
-	if(!stage->busy && !stage->stalled) {  
-			
-		// get insn from code mem ; copy values to stage latch	
-		stage->pc = cpu->pc;
-
-		insn_t* insn = &cpu->code[get_code_index(cpu->pc)];
-		strcpy(stage->opcode, insn->opcode);	
-		if(!is_valid_insn(stage->opcode)) {
-			stage->pc = -1;
-			cpu->stage[DRF] = cpu->stage[F];	
-			cpu->stage[F].stalled = 1;
-			update_print_stack("Fetch", cpu, cpu->code_size);
-			return 0;	
-		}
-		if(is_nop(stage->opcode)) {
-			update_print_stack("Fetch", cpu, cpu->code_size);
-			return 0;
+/*
+
+	Control-flow tracking
+
+*/
+
+// position of cfid in the cfq ; -1 if it is not in flight
+static int cfq_find(cpu_t* cpu, int cfid) {
+	int i = cpu->cfq_head_ptr;
+	for(int n=0; n<cpu->cfq_num; n++) {
+		if(cpu->cfq[i] == cfid) return i;
+		i = (i + 1) % cpu->config.cfq_size;
+	}
+	return -1;
+}
+
+// row b of a queue's branch masks ; bit i set while entry i is on the path of unresolved branch b
+static uint64_t* brmask_row(uint64_t* brmask, int n, int b) {
+	return &brmask[(size_t) b * bitmap_words(n)];
+}
+
+// every branch that has not executed yet gets this insn on its path ; a branch is not on its own path
+static void branch_path_add(cpu_t* cpu, int rob_idx, int iq_idx, int lsq_idx) {
+	int cfq_size = cpu->config.cfq_size;
+	for(int b=bitmap_first(cpu->unresolved, cfq_size); b!=-1; b=bitmap_next(cpu->unresolved, cfq_size, b+1)) {
+		bitmap_set(brmask_row(cpu->rob.brmask, cpu->rob.size, b), rob_idx);
+		if(iq_idx != -1) bitmap_set(brmask_row(cpu->iq_brmask, cpu->config.iq_size, b), iq_idx);
+		if(lsq_idx != -1) bitmap_set(brmask_row(cpu->lsq.brmask, cpu->lsq.size, b), lsq_idx);
+	}
+}
+
+// entries of one queue on the path of branch b that are in use (bit set in map, clear if map_free)
+static const uint64_t* branch_path(cpu_t* cpu, uint64_t* brmask, int n, const uint64_t* map, char map_free, int b) {
+	uint64_t* mask = cpu->tag_mask;
+	const uint64_t* row = brmask_row(brmask, n, b);
+	for(int w=0; w<bitmap_words(n); w++) {
+		mask[w] = row[w] & (map_free ? ~map[w] : map[w]);
+	}
+	return mask;
+}
+
+// branch b executed or was flushed ; nothing is squashed on its account any more
+static void branch_resolve(cpu_t* cpu, int b) {
+	bitmap_clear(cpu->unresolved, b);
+	memset(brmask_row(cpu->rob.brmask, cpu->rob.size, b), 0, bitmap_words(cpu->rob.size) * sizeof(uint64_t));
+	memset(brmask_row(cpu->iq_brmask, cpu->config.iq_size, b), 0, bitmap_words(cpu->config.iq_size) * sizeof(uint64_t));
+	memset(brmask_row(cpu->lsq.brmask, cpu->lsq.size, b), 0, bitmap_words(cpu->lsq.size) * sizeof(uint64_t));
+}
+
+// entries of one queue tagged with cfid no longer belong to a branch
+static void cfid_untag(cpu_t* cpu, int* cfids, int n, int cfid) {
+	uint64_t* mask = cpu->tag_mask;
+	memset(mask, 0, bitmap_words(n) * sizeof(uint64_t));
+	tag_match(cfids, n, cfid, mask);
+	for(int i=bitmap_first(mask, n); i!=-1; i=bitmap_next(mask, n, i+1)) {
+		cfids[i] = -1;
+	}
+}
+
+// the oldest control-flow insn committed ; insn still tagged with its cfid no longer belong to any branch, so the id can be reused
+static void cfid_retire(cpu_t* cpu, int cfid) {
+	bitmap_set(cpu->cfid_free, cfid);
+	cpu->cfq_head_ptr = (cpu->cfq_head_ptr + 1) % cpu->config.cfq_size;
+	cpu->cfq_num--;
+	if(cpu->cfid == cfid) cpu->cfid = -1;
+
+	cfid_untag(cpu, cpu->rob.cfid, cpu->rob.size, cfid);
+	cfid_untag(cpu, cpu->iq_cfid, cpu->config.iq_size, cfid);
+	cfid_untag(cpu, cpu->lsq.cfid, cpu->lsq.size, cfid);
+	for(int t=0; t<NUM_FU_TYPES; t++) {
+		fu_pool_t* pool = &cpu->fu[t];
+		for(int i=0; i<pool->units * pool->depth; i++) {
+			if(pool->slots[i].cfid == cfid) pool->slots[i].cfid = -1;
 		}
+	}
+	for(int i=0; i<cpu->mem_slots; i++) {
+		if(cpu->memFU[i].cfid == cfid) cpu->memFU[i].cfid = -1;
+	}
+}
 
-		stage->rd = insn->rd;
-		stage->rs1 = insn->rs1;
-		stage->rs2 = insn->rs2;
-		stage->imm = insn->imm;
-		stage->rd = insn->rd;
-		
-		// update pc for next insn
-		cpu->pc += 4;
-	
-		// create print_info for this insn
-		stage_t* p = &cpu->print_info[get_code_index(stage->pc)];
-		p->pc = stage->pc;
-		strcpy(p->opcode, insn->opcode);
-		p->rd = insn->rd;
-		p->rs1 = insn->rs1;
-		p->rs2 = insn->rs2;
-		p->imm = insn->imm;
-		p->rd = insn->rd;
-
-		cpu->stage[DRF] = cpu->stage[F];
-		
+// hands a group to the next latch ; a new group un-stalls the stage
+static void latch_pass(latch_t* from, latch_t* to, int count) {
+	memcpy(to->slots, from->slots, count * sizeof(stage_t));
+	to->count = count;
+	to->busy = 0;
+	to->stalled = 0;
+}
+
+// one line per slot ; pushed youngest first so the display lists the group oldest first
+static void print_latch(char* name, cpu_t* cpu, latch_t* latch, int count) {
+	for(int i=cpu->config.width-1; i>=0; i--) {
+		stage_t* stage = &latch->slots[i];
+		if(i >= count || !is_valid_insn(stage->opcode) || is_nop(stage->opcode)) update_print_stack(name, cpu, cpu->code_size); // NOP
+		else update_print_stack(name, cpu, get_code_index(stage->pc));
 	}
-	if(stage->busy > 0) stage->busy--;
+}
 
-	if(!is_valid_insn(stage->opcode) || is_nop(stage->opcode)) update_print_stack("Fetch", cpu, cpu->code_size); // NOP
-	else update_print_stack("Fetch", cpu, get_code_index(stage->pc));
+// one lifecycle event of insn seq ; only counted unless a trace is open
+static void trace_insn(cpu_t* cpu, int event, int seq, int pc, opcode_t opcode, int rob_idx, int iq_idx, int lsq_idx, int cfid) {
+	cpu->events++;
+	if(!cpu->trace) return;
+	trace_rec_t rec = { seq, cpu->clock, pc, rob_idx, iq_idx, lsq_idx, cfid, event, opcode, { 0, 0 } };
+	trace_write(cpu->trace, &rec);
+}
 
-	return 0;
+/*
+
+	Memory ordering ; LOADs that run ahead of the ROB head (load_issue conservative or speculative)
+
+*/
+
+// LOADs and STOREs outside memory never reach memFU or the caches
+static char mem_addr_ok(cpu_t* cpu, int addr) {
+	return addr >= 0 && addr < cpu->config.mem_size;
 }
 
-// rename instruction and obtain ready operands
-int decode(cpu_t* cpu) {
-	stage_t* stage = &cpu->stage[DRF];
-	if(!stage->busy && !stage->stalled) {
-		
-		if(!is_valid_insn(stage->opcode)) {
-			stage->pc = -1;
-			cpu->stage[DP] = cpu->stage[DRF]; 	
-			cpu->stage[DRF].stalled = 1;
-			update_print_stack("Decode", cpu, cpu->code_size);
-			return 0;	
+// distance from the LSQ head ; smaller is older
+static int lsq_age(cpu_t* cpu, int lsq_idx) {
+	return (lsq_idx - cpu->lsq.head_ptr + cpu->lsq.size) % cpu->lsq.size;
+}
+
+// oldest LOAD that can go to memFU ; -1 if none, *fwd_idx is the STORE it takes its value from or -1 for memory
+static int load_select(cpu_t* cpu, int* fwd_idx) {
+	lsq_t* lsq = &cpu->lsq;
+	for(int n=0, i=lsq->head_ptr; n<lsq->size && bitmap_test(lsq->taken, i); n++, i=(i+1)%lsq->size) {
+		lsq_entry_t* load = &lsq->entries[i];
+		if(load->opcode != OP_LOAD || !load->mem_addr_valid || load->issued) continue;
+		if(!mem_addr_ok(cpu, load->mem_addr)) continue; // may be on a wrong path ; it waits for the ROB head, where mem_fault() stops the run
+
+		// youngest older STORE first ; the nearest one to the same address holds the value
+		char blocked = 0;
+		*fwd_idx = -1;
+		for(int j=i; j!=lsq->head_ptr && !blocked && *fwd_idx == -1; ) {
+			j = (j + lsq->size - 1) % lsq->size;
+			lsq_entry_t* store = &lsq->entries[j];
+			if(store->opcode != OP_STORE) continue;
+			if(!store->mem_addr_valid) blocked = (cpu->config.load_issue == LOAD_CONSERVATIVE); // speculative goes past it
+			else if(store->mem_addr == load->mem_addr) {
+				if(store->u_rs2_ready) *fwd_idx = j;
+				else blocked = 1; // the data is not there yet
+			}
+		}
+		if(!blocked) return i;
+	}
+	return -1;
+}
+
+// a STORE address is known ; younger LOADs to it that did not see this STORE's data read a stale value
+static void order_check(cpu_t* cpu, int store_idx) {
+	lsq_t* lsq = &cpu->lsq;
+	lsq_entry_t* store = &lsq->entries[store_idx];
+	for(int i=(store_idx+1)%lsq->size; i!=lsq->tail_ptr; i=(i+1)%lsq->size) {
+		lsq_entry_t* load = &lsq->entries[i];
+		if(load->opcode != OP_LOAD || !load->issued || load->mem_addr != store->mem_addr) continue;
+		if(load->fwd_idx == -1 || lsq_age(cpu, load->fwd_idx) < lsq_age(cpu, store_idx)) load->violated = 1; // a STORE in between would have had the right value
+	}
+}
+
+// the LOAD at the ROB head read a stale value ; everything in flight is younger, so all of it goes and the LOAD reads memory again
+static void order_flush(cpu_t* cpu) {
+	int rob_idx = cpu->rob.head_ptr;
+	rob_entry_t* load = &cpu->rob.entries[rob_idx];
+	lsq_entry_t* lsqe = &cpu->lsq.entries[load->lsq_idx];
+	cpu->pc = load->pc + 4;
+	cpu->perf.order_flushes++;
+
+	// predictor history as it was before the oldest control-flow insn in flight
+	const bpred_info_t* pred = NULL;
+	if(cpu->cfq_num) pred = &cpu->saved_state[cpu->cfq[cpu->cfq_head_ptr]].pred;
+	for(int i=DP; i>=DRF && !pred; i--) { // the dispatch latch holds the older group
+		for(int j=0; j<cpu->stage[i].count && !pred; j++) {
+			stage_t* stage = &cpu->stage[i].slots[j];
+			if(is_valid_insn(stage->opcode) && is_controlflow(stage->opcode)) pred = &stage->pred;
 		}
+	}
+	if(pred) bpred_restore(&cpu->bpred, pred);
 
-		if(is_halt(stage->opcode)) {
-			cpu->stage[DP] = cpu->stage[DRF]; // move the halt to the next stage
-			cpu->stage[DRF].stalled = 1;
-			update_print_stack("Decode", cpu, get_code_index(stage->pc));
-			return 0;
+	for(int n=1, i=(rob_idx+1)%cpu->rob.size; n<cpu->rob.size && bitmap_test(cpu->rob.taken, i); n++, i=(i+1)%cpu->rob.size) {
+		rob_entry_t* robe = &cpu->rob.entries[i];
+		if(!is_nop(robe->opcode)) {
+			cpu->perf.squashed++;
+			trace_insn(cpu, TR_SQUASH, robe->seq, robe->pc, robe->opcode, i, -1, robe->lsq_idx, cpu->rob.cfid[i]);
 		}
-	
-		if(is_nop(stage->opcode)) {
-			//cpu->stage[DP] = cpu->stage[DRF]; 
-			update_print_stack("Decode", cpu, cpu->code_size);
-			return 0;
+		bitmap_clear(cpu->rob.taken, i);
+		if(!cpu->batch) cpu->print_info[get_code_index(robe->pc)].opcode = OP_NOP;
+	}
+	cpu->rob.tail_ptr = (rob_idx + 1) % cpu->rob.size;
+
+	for(int i=bitmap_next_clear(cpu->iq_free, cpu->config.iq_size, 0); i!=-1; i=bitmap_next_clear(cpu->iq_free, cpu->config.iq_size, i+1)) { // the LOAD left the IQ with its address
+		iq_release(cpu, i);
+	}
+	for(int n=1, i=(load->lsq_idx+1)%cpu->lsq.size; n<cpu->lsq.size && bitmap_test(cpu->lsq.taken, i); n++, i=(i+1)%cpu->lsq.size) {
+		bitmap_clear(cpu->lsq.taken, i);
+		wait_remove(cpu, lsq_wait_node(cpu, i));
+	}
+	cpu->lsq.tail_ptr = (load->lsq_idx + 1) % cpu->lsq.size;
+
+	for(int t=0; t<NUM_FU_TYPES; t++) {
+		fu_pool_t* pool = &cpu->fu[t];
+		for(int i=0; i<pool->units * pool->depth; i++) {
+			pool->slots[i].busy = -1;
+			pool->slots[i].opcode = OP_NOP;
 		}
+	}
+	for(int i=0; i<cpu->mem_slots; i++) {
+		if(cpu->memFU[i].opcode == OP_LOAD) { // a younger LOAD ; a STORE in memFU already committed
+			cpu->memFU[i].busy = -1;
+			cpu->memFU[i].opcode = OP_NOP;
+		}
+	}
+
+	// no branch in flight any more
+	bitmap_fill(cpu->cfid_free, cpu->config.cfq_size);
+	for(int b=0; b<cpu->config.cfq_size; b++) {
+		branch_resolve(cpu, b);
+	}
+	cpu->cfq_head_ptr = cpu->cfq_tail_ptr;
+	cpu->cfq_num = 0;
+	cpu->cfid = -1;
+
+	// only the committed mappings and the LOAD keep their registers
+	for(int i=0; i<cpu->config.num_unified_regs; i++) {
+		cpu->unified_regs[i].taken = 0;
+	}
+	for(int i=0; i<NUM_ARCH_REGS+1; i++) { // +1 for zero-flag
+		if(cpu->back_rename_table[i] != -1) cpu->unified_regs[cpu->back_rename_table[i]].taken = 1;
+	}
+	memcpy(cpu->front_rename_table, cpu->back_rename_table, (NUM_ARCH_REGS+1) * sizeof(int)); // +1 for zero-flag
+	cpu->front_rename_table[load->rd] = load->u_rd;
+	cpu->unified_regs[load->u_rd].taken = 1;
+	cpu->unified_regs[load->u_rd].valid = 0;
+	ureg_rebuild_free_list(cpu);
+
+	// back to the LSQ as if it never went
+	load->valid = 0;
+	lsqe->issued = 0;
+	lsqe->done = 0;
+	lsqe->violated = 0;
+	lsqe->fwd_idx = -1;
+
+	// the front-end only holds younger insn
+	for(int i=DRF; i<=DP; i++) { // the fetch latch only holds a copy of what decode has
+		for(int j=0; j<cpu->stage[i].count; j++) {
+			stage_t* stage = &cpu->stage[i].slots[j];
+			if(!is_valid_insn(stage->opcode)) continue;
+			cpu->perf.squashed++;
+			trace_insn(cpu, TR_SQUASH, stage->seq, stage->pc, stage->opcode, -1, -1, -1, -1);
+		}
+	}
+	for(int i=F; i<=DP; i++) {
+		cpu->stage[i].count = 0;
+		cpu->stage[i].stalled = 0;
+	}
+	cpu->stage[F].busy = 1;
+}
 
-		// rename the source registers ; if no source, renamed register is simply -1
-		stage->u_rs1 = cpu->front_rename_table[stage->rs1];
-		stage->u_rs2 = cpu->front_rename_table[stage->rs2];	
+int fetch(cpu_t* cpu) {
 	
-		// allocate a unified register if this instruction writes to a register	
-		if(has_rd(stage->opcode)) {
-			
-			// scan URF for free unified register
-			for(int i=0; i<NUM_UNIFIED_REGS; i++) {	
-				ureg_t* r = &cpu->unified_regs[i];
-				if(!r->taken) {
-					stage->u_rd = i;
-					r->taken = 1; // allocate unified reg
-					r->valid = 0;
-					r->zero_flag = 0;
-					break;
-				}
-			}
-			
-			if(stage->u_rd == -1) { // no more free unified registers ; stall
-				// printf("No more unified registers. Insert logic here...\n");
-				// block fetch for 1 cycle
-				cpu->stage[F].busy = 1;
-				update_print_stack("Decode", cpu, get_code_index(stage->pc));
-				return 0;
+	latch_t* latch = &cpu->stage[F];
+	if(!latch->busy && !latch->stalled && !cpu->stage[DRF].stalled) { // a new group would un-stall decode past a HALT
+		
+		// get up to width sequential insn from code mem ; copy values to the latch slots
+		latch->count = 0;
+		for(int n=0; n<cpu->config.width; n++) {
+			stage_t* stage = &latch->slots[latch->count];
+			stage->pc = cpu->pc;
+
+			int code_idx = get_code_index(cpu->pc);
+			insn_t* insn = (code_idx >= 0 && code_idx < cpu->code_size) ? &cpu->code[code_idx] : NULL;
+			stage->opcode = insn ? insn->opcode : OP_INVALID; // fetching past the end of code stalls like an invalid insn
+			if(!is_valid_insn(stage->opcode)) {
+				stage->pc = -1;
+				latch->count++;
+				latch->stalled = 1;
+				break;
 			}
-	
-			// update frontend rename table
-			cpu->front_rename_table[stage->rd] = stage->u_rd;
-			if(!is_mem(stage->opcode) && strcmp(stage->opcode, "MOVC")) cpu->front_rename_table[ZERO_FLAG] = stage->u_rd; // this insn becomes the most recent zero-flag value holder
-	
-			cpu->unified_regs[stage->u_rd].valid = 0;	
-		}
+
+			// update pc for next insn
+			cpu->pc += 4;
+			if(is_nop(stage->opcode)) continue; // uses up a fetch slot but never enters the pipeline
+
+			stage->rd = insn->rd;
+			stage->rs1 = insn->rs1;
+			stage->rs2 = insn->rs2;
+			stage->imm = insn->imm;
+			stage->seq = cpu->fetch_seq++;
+			latch->count++;
+			trace_insn(cpu, TR_FETCH, stage->seq, stage->pc, stage->opcode, -1, -1, -1, -1);
 		
-		// update print info
-		stage_t* p = &cpu->print_info[get_code_index(stage->pc)];
-		p->u_rd = stage->u_rd;
-		p->u_rs1 = stage->u_rs1;
-		p->u_rs2 = stage->u_rs2;
+			// create print_info for this insn
+			if(!cpu->batch) {
+				stage_t* p = &cpu->print_info[code_idx];
+				p->pc = stage->pc;
+				p->opcode = insn->opcode;
+				p->rd = insn->rd;
+				p->rs1 = insn->rs1;
+				p->rs2 = insn->rs2;
+				p->imm = insn->imm;
+			}
 
-		cpu->stage[DP] = cpu->stage[DRF]; // move to dispatch
+			// nothing after a HALT is fetched ; a flush un-stalls fetch if the HALT was on the wrong path
+			if(is_halt(stage->opcode)) {
+				latch->stalled = 1;
+				break;
+			}
 
+			// follow the predicted path ; a taken prediction ends the group
+			if(is_controlflow(stage->opcode)) {
+				cpu->pc = bpred_predict(&cpu->bpred, stage->pc, branch_kind(stage->opcode), stage->pc + stage->imm, &stage->pred);
+				if(cpu->pc != stage->pc + 4) break;
+			}
+		}
+
+		if(latch->count) latch_pass(latch, &cpu->stage[DRF], latch->count);
 	}
-	if(stage->busy > 0) stage->busy--;
+	if(latch->busy > 0) latch->busy--;
+
+	print_latch("Fetch", cpu, latch, latch->count);
 
-	if(!is_valid_insn(stage->opcode) || is_nop(stage->opcode)) update_print_stack("Decode", cpu, cpu->code_size); // NOP
-	else update_print_stack("Decode", cpu, get_code_index(stage->pc));
-	
 	return 0;
 }
 
-// create LSQ, IQ, and ROB entries
-int dispatch(cpu_t* cpu) {
-	
-	stage_t* stage = &cpu->stage[DP];
-	if(!stage->busy && !stage->stalled) {	
-		
-		if(!is_valid_insn(stage->opcode)) {
-			stage->pc = -1;	
-			cpu->stage[DP].stalled = 1;
-			update_print_stack("Dispatch", cpu, cpu->code_size); // NOP
-			return 0;	
+// rename a group of instructions and obtain ready operands ; insn are renamed in program order, so each one sees the mappings of the older insn in its group
+int decode(cpu_t* cpu) {
+	latch_t* latch = &cpu->stage[DRF];
+	print_latch("Decode", cpu, latch, latch->count);
+	if(!latch->busy && !latch->stalled && latch->count) {
+
+		// the group is renamed as a whole ; stall unless every destination gets a unified register
+		int needed = 0;
+		for(int i=0; i<latch->count; i++) {
+			if(has_rd(latch->slots[i].opcode)) needed++;
 		}
-		if(is_nop(stage->opcode)) {
-			update_print_stack("Dispatch", cpu, cpu->code_size); // NOP
+		if(needed > free_unified_regs(cpu)) {
+			cpu->perf.stalls[STALL_UREG]++;
+			// block fetch for 1 cycle
+			cpu->stage[F].busy = 1;
 			return 0;
 		}
 
-		// create an LSQ entry if this is a memory operation	
-		int lsq_idx = -1; // IQ entry needs this value
-		if(is_mem(stage->opcode)) {
-			lsq_t* lsq = &cpu->lsq;		
-			// if LSQ is full
-			if(lsq->entries[lsq->tail_ptr].taken) {
-				//printf("LSQ full... Insert logic here.\n");
-				// block Fetch and Decode stage for 1 cycle
-				cpu->stage[F].busy = 1;
-				cpu->stage[DRF].busy = 1;
-				update_print_stack("Dispatch", cpu, get_code_index(stage->pc));
-				return 0;
-			} else { // create an LSQ entry
-				lsq_idx = lsq->tail_ptr;
-				lsq_entry_t* lsqe = &lsq->entries[lsq_idx];
-			
-				lsqe->done = 0;	
-				lsqe->pc = stage->pc;
-	
-				lsqe->taken = 1;
-				strcpy(lsqe->opcode, stage->opcode); // load or store
-				lsqe->mem_addr_valid = 0;	
-				lsqe->cfid = cpu->cfid; // control-flow insn
-
-				 // only for loads	
-				lsqe->u_rd = stage->u_rd;
-				// only for stores
-				lsqe->u_rs2_ready = 0;
-				lsqe->u_rs2 = stage->u_rs2;							
-	
-				lsq->tail_ptr = (lsq->tail_ptr + 1) % LSQ_SIZE;
+		int n = 0;
+		while(n < latch->count) {
+			stage_t* stage = &latch->slots[n++];
+
+			// nothing past an invalid insn or a HALT moves on ; younger insn in the group are dropped
+			if(!is_valid_insn(stage->opcode) || is_halt(stage->opcode)) {
+				if(is_halt(stage->opcode)) trace_insn(cpu, TR_RENAME, stage->seq, stage->pc, stage->opcode, -1, -1, -1, -1);
+				latch->stalled = 1;
+				break;
 			}
-		} // create LSQ entry ; end
+			trace_insn(cpu, TR_RENAME, stage->seq, stage->pc, stage->opcode, -1, -1, -1, -1);
+
+			// rename the source registers ; if no source, renamed register is simply -1
+			stage->u_rs1 = stage->rs1 == -1 ? -1 : cpu->front_rename_table[stage->rs1];
+			stage->u_rs2 = stage->rs2 == -1 ? -1 : cpu->front_rename_table[stage->rs2];	
+			if(reads_zero_flag(stage->opcode)) stage->zero_flag_u_rd = cpu->front_rename_table[ZERO_FLAG]; // the u_rd that will produce the closest instance of the zero-flag
+	
+			// allocate a unified register if this instruction writes to a register	
+			if(has_rd(stage->opcode)) {
+				
+				stage->u_rd = ureg_alloc(cpu); // head of the free list
 		
-		// create ROB entry
-		rob_t* rob = &cpu->rob;
-		int rob_idx = -1;
-		if(rob->entries[rob->tail_ptr].taken) {
-			//printf("ROB full. Insert logic here...\n");
-			// block Fetch and Decode stage for 1 cycle
-			cpu->stage[F].busy = 1;
-			cpu->stage[DRF].busy = 1;
-			update_print_stack("Dispatch", cpu, get_code_index(stage->pc));
-			return 0;
+				// update frontend rename table
+				cpu->front_rename_table[stage->rd] = stage->u_rd;
+				if(sets_zero_flag(stage->opcode)) cpu->front_rename_table[ZERO_FLAG] = stage->u_rd; // this insn becomes the most recent zero-flag value holder
+			}
 
-		} else {
-			rob_idx = rob->tail_ptr;
-			rob_entry_t* robe = &rob->entries[rob_idx];
-			robe->taken = 1;
-			robe->valid = 0;
-			strcpy(robe->opcode, stage->opcode);
-			robe->pc = stage->pc;
-			robe->rd = stage->rd;
-			robe->u_rd = stage->u_rd;
-			robe->lsq_idx = lsq_idx;		
-			robe->cfid = cpu->cfid;	// control-flow id
-
-			if(is_mem(stage->opcode) && lsq_idx != -1) cpu->lsq.entries[lsq_idx].rob_idx = rob_idx;
-			if(is_halt(stage->opcode)) {
-				robe->valid = 1;
-			} if(is_controlflow(stage->opcode)) { // BZ, BNZ, JUMP
-				// look for a free cfid
-				char found = 0;
-				for(int i=0; i<CFQ_SIZE; i++) {
-					if(!cpu->cfid_freelist[i]) {
-						cpu->cfid = i;
-						found = 1;
-						break;	
-					}
-				}
-				if(!found) {
-					//printf("No more cfids. Insert logic here...\n");
-					cpu->stage[F].busy = 1;
-					cpu->stage[DRF].busy = 1;
-					update_print_stack("Dispatch", cpu, get_code_index(stage->pc));	
-					return 0;
-				}
+			// younger insn in the group are not part of the state restored if this insn is taken
+			if(is_controlflow(stage->opcode)) {
+				memcpy(stage->rename_table, cpu->front_rename_table, (NUM_ARCH_REGS+1) * sizeof(int)); // +1 for zero-flag
+				stage->free_head = cpu->free_head;
+			}
+			
+			// update print info
+			if(!cpu->batch) {
+				stage_t* p = &cpu->print_info[get_code_index(stage->pc)];
+				p->u_rd = stage->u_rd;
+				p->u_rs1 = stage->u_rs1;
+				p->u_rs2 = stage->u_rs2;
+			}
+		}
 
-				// add new cfid to cfq
-				cpu->cfq[cpu->cfq_tail_ptr] = cpu->cfid;
-				cpu->cfq_tail_ptr = (cpu->cfq_tail_ptr + 1) % CFQ_SIZE;
+		for(int i=n; i<latch->count; i++) { // dropped after a HALT
+			stage_t* stage = &latch->slots[i];
+			if(is_valid_insn(stage->opcode)) trace_insn(cpu, TR_SQUASH, stage->seq, stage->pc, stage->opcode, -1, -1, -1, -1);
+		}
+		latch_pass(latch, &cpu->stage[DP], n); // move to dispatch
+		latch->count = 0;
+	}
+	if(latch->busy > 0) latch->busy--;
+	
+	return 0;
+}
 
-				// save the state of URF and rename table ; in case branch-taken, must restore URF and rename table
-				memcpy(cpu->saved_state[cpu->cfid].unified_regs, cpu->unified_regs, NUM_UNIFIED_REGS * sizeof(ureg_t));
-				memcpy(cpu->saved_state[cpu->cfid].front_rename_table, cpu->front_rename_table, (NUM_ARCH_REGS+1) * sizeof(int)); // +1 for zero-flag
+static int iq_find_free(cpu_t* cpu) {
+	return bitmap_first(cpu->iq_free, cpu->config.iq_size);
+}
 
-				// re-assign new cfid to this branch insn
-				robe->cfid = cpu->cfid;	
-			}
-	
-			rob->tail_ptr = (rob->tail_ptr + 1) % ROB_SIZE;	
-		} // create ROB entry ; end
-	
-		// create IQ entry	
-		int iq_idx = -1;	
-		if(!is_halt(stage->opcode)) {
-			iq_entry_t* iq = cpu->iq;
-			// scan IQ and look for a free entry
-			for(int i=0; i<IQ_SIZE; i++) {
-				iq_entry_t* iqe = &iq[i];
-				if(!iqe->taken) {
-					iq_idx = i;
-					iqe->taken = 1;
-					iqe->cycle_dispatched = cpu->clock;
-	
-					iqe->pc = stage->pc; // just for printing
-					iqe->rob_idx = rob_idx;			
-					iqe->lsq_idx = lsq_idx;
-	
-					strcpy(iqe->opcode, stage->opcode);
-					iqe->imm = stage->imm;
-					
-					iqe->u_rs1 = stage->u_rs1;
-					iqe->u_rs1_ready = 0;
-	
-					iqe->u_rs2 = stage->u_rs2;
-					iqe->u_rs2_ready = 0;
+static int cfid_find_free(cpu_t* cpu) {
+	return bitmap_first(cpu->cfid_free, cpu->config.cfq_size);
+}
 
-					if(strcmp(iqe->opcode, "BZ") == 0 || strcmp(iqe->opcode, "BNZ") == 0) {
-						iqe->zero_flag_u_rd = cpu->front_rename_table[ZERO_FLAG]; // get the u_rd that will produce the closest instance of the zero-flag
-						iqe->zero_flag_ready = 0;	
-					}
+// checks every entry this insn needs before allocating any of them ; the STALL_* cause if one is not free, STALL_NONE otherwise
+static int dispatch_full(cpu_t* cpu, stage_t* stage) {
+	if(is_mem(stage->opcode) && bitmap_test(cpu->lsq.taken, cpu->lsq.tail_ptr)) return STALL_LSQ;
+	if(bitmap_test(cpu->rob.taken, cpu->rob.tail_ptr)) return STALL_ROB;
+	if(is_controlflow(stage->opcode) && cfid_find_free(cpu) == -1) return STALL_CFID;
+	if(!is_halt(stage->opcode) && iq_find_free(cpu) == -1) return STALL_IQ;
+	return STALL_NONE;
+}
+
+// create LSQ, IQ, and ROB entries for slot of the dispatch latch ; dispatch_full() must have passed
+static void dispatch_insn(cpu_t* cpu, latch_t* latch, int slot) {
+	stage_t* stage = &latch->slots[slot];
+
+	// create an LSQ entry if this is a memory operation	
+	int lsq_idx = -1; // IQ entry needs this value
+	if(is_mem(stage->opcode)) {
+		lsq_t* lsq = &cpu->lsq;		
+		lsq_idx = lsq->tail_ptr;
+		lsq_entry_t* lsqe = &lsq->entries[lsq_idx];
 	
-					// control-flow id
-					iqe->cfid = cpu->cfid;	
+		lsqe->done = 0;	
+		lsqe->pc = stage->pc;
+
+		bitmap_set(lsq->taken, lsq_idx);
+		lsqe->opcode = stage->opcode; // load or store
+		lsqe->mem_addr_valid = 0;	
+		lsq->cfid[lsq_idx] = cpu->cfid; // control-flow insn
+
+		 // only for loads	
+		lsqe->u_rd = stage->u_rd;
+		// only for stores
+		lsqe->u_rs2_ready = 0;
+		lsqe->u_rs2 = stage->u_rs2;							
+		// only for loads that run ahead of the ROB head
+		lsqe->issued = 0;
+		lsqe->fwd_idx = -1;
+		lsqe->violated = 0;
+
+		lsq->tail_ptr = (lsq->tail_ptr + 1) % cpu->lsq.size;
+	} // create LSQ entry ; end
 	
-					// check if insn do not need particular source registers ; set them to ready so they do not wait for them 
-					
-					// insn with only literal	
-					if(strcmp(iqe->opcode, "MOVC") == 0) {
-						iqe->u_rs1_ready = 1;
-						iqe->u_rs2_ready = 1;
-					}
-					if(strcmp(iqe->opcode, "BZ") == 0 || strcmp(iqe->opcode, "BNZ") == 0) {
-						iqe->u_rs1_ready = 1;
-						iqe->u_rs2_ready = 1;
-					}
-					// insn with register and literal	
-					if(strcmp(iqe->opcode, "LOAD") == 0 || strcmp(iqe->opcode, "ADDL") == 0 || strcmp(iqe->opcode, "SUBL") == 0 || strcmp(iqe->opcode, "JAL") == 0) {
-						iqe->u_rs2_ready = 1;
-					}
-					if(strcmp(iqe->opcode, "JUMP") == 0) {
-						iqe->u_rs2_ready = 1;
-					}		
+	// create ROB entry
+	rob_t* rob = &cpu->rob;
+	int rob_idx = rob->tail_ptr;
+	rob_entry_t* robe = &rob->entries[rob_idx];
+	bitmap_set(rob->taken, rob_idx);
+	robe->valid = 0;
+	robe->opcode = stage->opcode;
+	robe->pc = stage->pc;
+	robe->rd = stage->rd;
+	robe->u_rd = stage->u_rd;
+	robe->lsq_idx = lsq_idx;		
+	rob->cfid[rob_idx] = cpu->cfid;	// control-flow id
+	robe->seq = stage->seq;
+
+	if(is_mem(stage->opcode)) cpu->lsq.entries[lsq_idx].rob_idx = rob_idx;
+	if(is_halt(stage->opcode)) {
+		robe->valid = 1;
+	} if(is_controlflow(stage->opcode)) { // BZ, BNZ, JUMP
+		cpu->cfid = cfid_find_free(cpu);
+		bitmap_clear(cpu->cfid_free, cpu->cfid);
+
+		// add new cfid to cfq
+		cpu->cfq[cpu->cfq_tail_ptr] = cpu->cfid;
+		cpu->cfq_tail_ptr = (cpu->cfq_tail_ptr + 1) % cpu->config.cfq_size;
+		cpu->cfq_num++;
+
+		// checkpoint the rename table and free list as decode left them ; in case branch-taken, both go back
+		saved_state_t* saved = &cpu->saved_state[cpu->cfid];
+		memcpy(saved->front_rename_table, stage->rename_table, (NUM_ARCH_REGS+1) * sizeof(int)); // +1 for zero-flag
+		saved->free_head = stage->free_head;
+		saved->pred = stage->pred;
+
+		// re-assign new cfid to this branch insn
+		rob->cfid[rob_idx] = cpu->cfid;	
+	}
+
+	rob->tail_ptr = (rob->tail_ptr + 1) % cpu->rob.size;	
+	// create ROB entry ; end
+
+	// create IQ entry	
+	int iq_idx = -1;	
+	if(!is_halt(stage->opcode)) {
+		iq_idx = iq_find_free(cpu);
+		iq_entry_t* iqe = &cpu->iq[iq_idx];
+		age_insert(cpu, iq_idx);
+		bitmap_clear(cpu->iq_free, iq_idx);
+		cpu->iq_num++;
+		iqe->cycle_dispatched = cpu->clock;
+
+		iqe->pc = stage->pc; // just for printing
+		iqe->rob_idx = rob_idx;			
+		iqe->lsq_idx = lsq_idx;
+
+		iqe->opcode = stage->opcode;
+		iqe->imm = stage->imm;
 		
-					// check if any source registers are ready
-					if(cpu->unified_regs[iqe->u_rs1].valid) {
-						iqe->u_rs1_ready = 1;
-						iqe->u_rs1_val = cpu->unified_regs[iqe->u_rs1].val;
-					}
-					if(cpu->unified_regs[iqe->u_rs2].valid) {
-						iqe->u_rs2_ready = 1;
-						if(strcmp(iqe->opcode, "STORE") == 0) {
-							lsq_entry_t* lsqe = &cpu->lsq.entries[iqe->lsq_idx];
-							lsqe->u_rs2_ready = 1;
-							lsqe->u_rs2_val = cpu->unified_regs[iqe->u_rs2].val;	
-						}
-						iqe->u_rs2_val = cpu->unified_regs[iqe->u_rs2].val;
-					}
-					// zero-flag
-					if(strcmp(iqe->opcode, "BZ") == 0 || strcmp(iqe->opcode, "BNZ") == 0) {
-						if(cpu->unified_regs[iqe->zero_flag_u_rd].valid) iqe->zero_flag_ready=  1;	
-					}
+		iqe->u_rs1 = stage->u_rs1;
+		iqe->u_rs1_ready = 0;
 
-				
-					break;
-				}
-			} // create IQ entry ; end
-			if(iq_idx < 0) {
-				//printf("IQ full... insert logic here...\n");
-				// block Fetch and Decode stage for 1 cycle
-				cpu->stage[F].busy = 1;
-				cpu->stage[DRF].busy = 1;
-				update_print_stack("Dispatch", cpu, get_code_index(stage->pc));
-				return 0;
-			}	
-		} // !is_halt() ; end
-	
-		// update print info
-		stage_t* p = &cpu->print_info[get_code_index(stage->pc)];
-		p->rob_idx = rob_idx;
-		p->iq_idx = iq_idx;
-		p->lsq_idx = lsq_idx;
-		p->cfid = cpu->cfid;
-	}
-	if(stage->busy > 0) stage->busy--;
+		iqe->u_rs2 = stage->u_rs2;
+		iqe->u_rs2_ready = 0;
 
-	if(!is_valid_insn(stage->opcode) || is_nop(stage->opcode)) update_print_stack("Dispatch", cpu, cpu->code_size);
-	else update_print_stack("Dispatch", cpu, get_code_index(stage->pc));
-	
-	return 0;
-}
+		if(reads_zero_flag(iqe->opcode)) {
+			iqe->zero_flag_u_rd = stage->zero_flag_u_rd;
+			iqe->zero_flag_ready = 0;	
+		}
 
-int issue(cpu_t* cpu) {
-			
-	// look for the earliest dispatched insn with all operands ready and send to FU	
-	iq_entry_t* iq = cpu->iq;
-	int earliest_cycle_intFU = INT_MAX;
-	int earliest_intFU = INT_MAX;
-	
-	int earliest_cycle_mulFU = INT_MAX;
-	int earliest_mulFU = INT_MAX;
+		// control-flow id
+		cpu->iq_cfid[iq_idx] = cpu->cfid;	
 
-	for(int i=0; i<IQ_SIZE; i++) {
-		iq_entry_t* iqe = &iq[i];
-		if(!iqe->taken)	continue;
-	
-		// check if any source registers are ready
-		if(!iqe->u_rs1_ready && cpu->unified_regs[iqe->u_rs1].valid) {
+		// check if insn do not need particular source registers ; set them to ready so they do not wait for them 
+		if(!(opcode_props[iqe->opcode] & OPP_RS1)) iqe->u_rs1_ready = 1;
+		if(!(opcode_props[iqe->opcode] & OPP_RS2)) iqe->u_rs2_ready = 1;
+
+		// check if any source registers are ready ; a source that was never written (no mapping) reads as 0
+		// operands that are not ready wait on their producer's broadcast
+		if(iqe->u_rs1 == -1) {
+			iqe->u_rs1_ready = 1;
+			iqe->u_rs1_val = 0;
+		} else if(cpu->unified_regs[iqe->u_rs1].valid) {
 			iqe->u_rs1_ready = 1;
 			iqe->u_rs1_val = cpu->unified_regs[iqe->u_rs1].val;
+		} else if(!iqe->u_rs1_ready) {
+			wait_add(cpu, iq_idx * NUM_IQ_WAITS + WAIT_RS1, iqe->u_rs1);
 		}
-		if(!iqe->u_rs2_ready && cpu->unified_regs[iqe->u_rs2].valid) {
+		if(iqe->u_rs2 == -1) {
+			iqe->u_rs2_ready = 1;
+			iqe->u_rs2_val = 0;
+			if(iqe->opcode == OP_STORE) {
+				lsq_entry_t* lsqe = &cpu->lsq.entries[iqe->lsq_idx];
+				lsqe->u_rs2_ready = 1;
+				lsqe->u_rs2_val = 0;
+			}
+		} else if(cpu->unified_regs[iqe->u_rs2].valid) {
 			iqe->u_rs2_ready = 1;
+			if(iqe->opcode == OP_STORE) {
+				lsq_entry_t* lsqe = &cpu->lsq.entries[iqe->lsq_idx];
+				lsqe->u_rs2_ready = 1;
+				lsqe->u_rs2_val = cpu->unified_regs[iqe->u_rs2].val;	
+			}
 			iqe->u_rs2_val = cpu->unified_regs[iqe->u_rs2].val;
+		} else {
+			if(!iqe->u_rs2_ready) wait_add(cpu, iq_idx * NUM_IQ_WAITS + WAIT_RS2, iqe->u_rs2);
+			if(iqe->opcode == OP_STORE) wait_add(cpu, lsq_wait_node(cpu, iqe->lsq_idx), iqe->u_rs2); // store data
+		}
+		// zero-flag ; no producer yet means the flag is clear
+		if(reads_zero_flag(iqe->opcode)) {
+			if(iqe->zero_flag_u_rd == -1 || cpu->unified_regs[iqe->zero_flag_u_rd].valid) iqe->zero_flag_ready=  1;	
+			else wait_add(cpu, iq_idx * NUM_IQ_WAITS + WAIT_ZF, iqe->zero_flag_u_rd);
 		}
 
-		// search for the earliest ready instruction for each FU
-	
-		if(cpu->intFU.busy <= 0 && is_intFU(iqe->opcode)) { // if this FU is free and this insn goes to intFU
-			char ready = iqe->u_rs1_ready && iqe->u_rs2_ready;
-			
-			if(strcmp(iqe->opcode, "LOAD") == 0 || strcmp(iqe->opcode, "STORE") == 0) { // mem insn only need rs1 to be ready 
-				ready = iqe->u_rs1_ready;
-			}
+		if(iq_entry_ready(iqe)) ready_insert(cpu, iq_idx);
+	} // create IQ entry ; end
 
-			if(strcmp(iqe->opcode, "BZ") == 0 || strcmp(iqe->opcode, "BNZ") == 0) { // for these insn, zero-flag value must also be ready
-				ready = ready & iqe->zero_flag_ready;
-			}
+	// on the path of every older branch not executed yet ; a branch starts its own path after itself
+	branch_path_add(cpu, rob_idx, iq_idx, lsq_idx);
+	if(is_controlflow(stage->opcode)) bitmap_set(cpu->unresolved, rob->cfid[rob_idx]);
+	trace_insn(cpu, TR_DISPATCH, stage->seq, stage->pc, stage->opcode, rob_idx, iq_idx, lsq_idx, rob->cfid[rob_idx]);
 
-			if(ready) {	
-				if(iqe->cycle_dispatched < earliest_cycle_intFU) {
-					earliest_intFU = i;
-					earliest_cycle_intFU = iqe->cycle_dispatched; 
-				}
-			}
-		}
-		if(cpu->mulFU.busy <= 0 && (strcmp(iqe->opcode, "MUL") == 0)) {	
-			if(iqe->u_rs1_ready && iqe->u_rs2_ready) {
-				if(iqe->cycle_dispatched < earliest_cycle_mulFU) {
-					earliest_mulFU = i;
-					earliest_cycle_mulFU = iqe->cycle_dispatched; 
-				}
-			}
-		}
-	}	
+	// update print info
+	if(!cpu->batch) {
+		stage_t* p = &cpu->print_info[get_code_index(stage->pc)];
+		p->rob_idx = rob_idx;
+		p->iq_idx = iq_idx;
+		p->lsq_idx = lsq_idx;
+		p->cfid = cpu->cfid;
+	}
+}
+
+// dispatches the group in program order ; stops at the first insn whose entries are not all free
+int dispatch(cpu_t* cpu) {
 	
-	// issue for intFU
-	// send ready insn to intFU
-	if(earliest_intFU != INT_MAX) { // means intFU is free and found a ready insn
-		iq_entry_t* iqe = &cpu->iq[earliest_intFU];
-		iqe->taken = 0; // free this IQ entry
-		
-		// send this insn to intFU
-		fu_t* intFU = &cpu->intFU;
-		rob_entry_t* robe = &cpu->rob.entries[iqe->rob_idx];
-		intFU->rob_idx = iqe->rob_idx;
-		strcpy(intFU->opcode, iqe->opcode);
-		intFU->pc = robe->pc;
-		intFU->u_rd = robe->u_rd; // target register
-		intFU->cfid = robe->cfid; // control-flow id
-
-		intFU->imm = iqe->imm;
-		intFU->u_rs1_val = iqe->u_rs1_val;
-		intFU->u_rs2_val = iqe->u_rs2_val;
+	latch_t* latch = &cpu->stage[DP];
+	print_latch("Dispatch", cpu, latch, latch->count);
+	if(!latch->busy && !latch->stalled) {	
 		
-		if(strcmp(iqe->opcode, "BZ") == 0 || strcmp(iqe->opcode, "BNZ") == 0) { // for these insn, zero-flag value must also be ready
-			intFU->zero_flag = cpu->unified_regs[iqe->zero_flag_u_rd].zero_flag;
+		int n = 0;
+		for(; n<latch->count; n++) {
+			stage_t* stage = &latch->slots[n];
+			if(!is_valid_insn(stage->opcode)) {
+				latch->stalled = 1;
+				break;
+			}
+			int stall = dispatch_full(cpu, stage);
+			if(stall != STALL_NONE) {
+				cpu->perf.stalls[stall]++;
+				// block Fetch and Decode stage for 1 cycle
+				cpu->stage[F].busy = 1;
+				cpu->stage[DRF].busy = 1;
+				break;
+			}
+			dispatch_insn(cpu, latch, n);
 		}
-	
-		intFU->busy = INT_FU_LAT; // latency + issue latency
 
-		// printing stuff
-		intFU->print_idx = get_code_index(iqe->pc);
-		//update_print_stack("Issue", cpu, intFU->print_idx);
+		// insn that were not dispatched wait in the latch
+		memmove(latch->slots, &latch->slots[n], (latch->count - n) * sizeof(stage_t));
+		latch->count -= n;
 	}
+	if(latch->busy > 0) latch->busy--;
 
-	// send ready insn to mulFU
-	if(earliest_mulFU != INT_MAX) { // means mulFU is free and found a ready insn
-		iq_entry_t* iqe = &cpu->iq[earliest_mulFU];
-		iqe->taken = 0; // free this IQ entry
-		
-		// send this insn to mulFU
-		fu_t* mulFU = &cpu->mulFU;
-		rob_entry_t* robe = &cpu->rob.entries[iqe->rob_idx];
-		mulFU->rob_idx = iqe->rob_idx;
-		strcpy(mulFU->opcode, iqe->opcode);
-		mulFU->u_rd = robe->u_rd; // target register
-		mulFU->cfid = robe->cfid; // control-flow id
-
-		mulFU->imm = iqe->imm;
-		mulFU->u_rs1_val = iqe->u_rs1_val;
-		mulFU->u_rs2_val = iqe->u_rs2_val;
+	return 0;
+}
+
+// a free slot of this unit ; -1 while its last insn started less than ii cycles ago
+static int unit_slot(fu_pool_t* pool, int unit) {
+	int slot = -1;
+	for(int s=unit; s<pool->units * pool->depth; s+=pool->units) {
+		fu_t* fu = &pool->slots[s];
+		if(fu->busy > pool->lat - pool->ii) return -1;
+		if(fu->busy <= 0 && slot == -1) slot = s;
+	}
+	return slot;
+}
+
+int issue(cpu_t* cpu) {
+			
+	// each unit that can start an insn takes the oldest ready one of its FU type ; the next unit then gets the next oldest
+	int iq_size = cpu->config.iq_size;
+	for(int t=0; t<NUM_FU_TYPES; t++) {
+		fu_pool_t* pool = &cpu->fu[t];
+		uint64_t* ready = ready_set(cpu, t);
+		for(int u=0; u<pool->units; u++) {
+			if(bitmap_first(ready, iq_size) == -1) break;
+			int slot = unit_slot(pool, u);
+			if(slot == -1) continue; // unit must be free
+			int earliest = age_select(cpu, ready);
+
+			iq_entry_t* iqe = &cpu->iq[earliest];
+			iq_release(cpu, earliest); // free this IQ entry
+			
+			// send this insn to the unit
+			fu_t* fu = &pool->slots[slot];
+			rob_entry_t* robe = &cpu->rob.entries[iqe->rob_idx];
+			fu->rob_idx = iqe->rob_idx;
+			fu->opcode = iqe->opcode;
+			fu->pc = robe->pc;
+			fu->u_rd = robe->u_rd; // target register
+			fu->cfid = cpu->rob.cfid[iqe->rob_idx]; // control-flow id
+			fu->seq = robe->seq;
+			trace_insn(cpu, TR_ISSUE, robe->seq, robe->pc, iqe->opcode, iqe->rob_idx, earliest, iqe->lsq_idx, cpu->rob.cfid[iqe->rob_idx]);
+
+			fu->imm = iqe->imm;
+			fu->u_rs1_val = iqe->u_rs1_val;
+			fu->u_rs2_val = iqe->u_rs2_val;
 			
-		mulFU->busy = MUL_FU_LAT; // latency + issue latency
+			if(reads_zero_flag(iqe->opcode)) { // for these insn, zero-flag value must also be ready
+				fu->zero_flag = iqe->zero_flag_u_rd == -1 ? 0 : cpu->unified_regs[iqe->zero_flag_u_rd].zero_flag;
+			}
+		
+			fu->busy = pool->lat; // latency + issue latency
 
-		// printing stuff
-		mulFU->print_idx = get_code_index(iqe->pc);
-		//update_print_stack("Issue", cpu, mulFU->print_idx);
+			// printing stuff
+			fu->print_idx = get_code_index(iqe->pc);
+		}
 	}
+
+	// every free unit took a ready insn ; whatever is still ready waits on a busy one
+	if(bitmap_first(ready_set(cpu, FU_INT), iq_size) != -1) cpu->perf.stalls[STALL_INT_FU]++;
+	if(bitmap_first(ready_set(cpu, FU_MUL), iq_size) != -1) cpu->perf.stalls[STALL_MUL_FU]++;
+	if(bitmap_first(ready_set(cpu, FU_AGU), iq_size) != -1) cpu->perf.stalls[STALL_AGU]++;
 	
 	return 0;
 	
 }
 
-// broadcast calculated value to waiting insn in IQ
+// broadcast calculated value to the insn in IQ and LSQ waiting on u_rd
 void broadcast(cpu_t* cpu, int u_rd, int u_rd_val) {
 
-	iq_entry_t* iq = cpu->iq;
-	for(int i=0; i<IQ_SIZE; i++) {
-		iq_entry_t* iqe = &iq[i];
-		if(iqe->taken) {
-			if(u_rd == iqe->u_rs1) {
-				iqe->u_rs1_ready = 1;
-				iqe->u_rs1_val = u_rd_val;	
-			}
-			if(u_rd == iqe->u_rs2) {
-				iqe->u_rs2_ready = 1;
-				iqe->u_rs2_val = u_rd_val;	
-			}
-			// broadcast the zero-flag value
-			if(strcmp(iqe->opcode, "BZ") == 0 || strcmp(iqe->opcode, "BNZ") == 0) {
-				if(iqe->zero_flag_u_rd == u_rd) iqe->zero_flag_ready = 1;	
-			}
-		} // if iqe->taken ; end
-	}
+	int node = cpu->wait_head[u_rd];
+	cpu->wait_head[u_rd] = -1; // every consumer is woken up
+	while(node != -1) {
+		wait_node_t* n = &cpu->wait_nodes[node];
+		int next = n->next;
+		n->reg = -1;
 
-	lsq_entry_t* lsq = cpu->lsq.entries;	
-	for(int i=0; i<LSQ_SIZE; i++) {
-		lsq_entry_t* lsqe = &lsq[i];
-		if(lsqe->taken) {
-			if(u_rd == lsqe->u_rs2) {
-				lsqe->u_rs2_val = u_rd_val;
-				lsqe->u_rs2_ready = 1;	
+		if(node >= cpu->config.iq_size * NUM_IQ_WAITS) { // data to be stored
+			lsq_entry_t* lsqe = &cpu->lsq.entries[node - cpu->config.iq_size * NUM_IQ_WAITS];
+			lsqe->u_rs2_val = u_rd_val;
+			lsqe->u_rs2_ready = 1;	
+		} else {
+			int iq_idx = node / NUM_IQ_WAITS;
+			iq_entry_t* iqe = &cpu->iq[iq_idx];
+			switch(node % NUM_IQ_WAITS) {
+				case WAIT_RS1:
+					iqe->u_rs1_ready = 1;
+					iqe->u_rs1_val = u_rd_val;	
+					break;
+				case WAIT_RS2:
+					iqe->u_rs2_ready = 1;
+					iqe->u_rs2_val = u_rd_val;	
+					break;
+				case WAIT_ZF: // broadcast the zero-flag value
+					iqe->zero_flag_ready = 1;	
+					break;
 			}
+			if(iq_entry_ready(iqe)) ready_insert(cpu, iq_idx);
 		}
+		node = next;
 	}
 
 }
 
-int execute(cpu_t* cpu) {
-
-	issue(cpu); // selects an instruction that is ready
-
-	// check each FU
-
-	// intFU	
-	fu_t* intFU = &cpu->intFU;
-	intFU->busy--;
-	if(!intFU->busy) {
-
-		rob_entry_t* robe = &cpu->rob.entries[intFU->rob_idx];	
-		ureg_t* u_rd = &cpu->unified_regs[robe->u_rd];
-		// perform computation
-		if(strcmp(intFU->opcode, "LOAD") == 0 || strcmp(intFU->opcode, "STORE") == 0) { // memory address computation
-			lsq_entry_t* lsqe = &cpu->lsq.entries[robe->lsq_idx];
-			lsqe->mem_addr = intFU->u_rs1_val + intFU->imm;
-			lsqe->mem_addr_valid = 1;
-		} else { // arithmetic insn	
-			if(strcmp(intFU->opcode, "MOVC") == 0) u_rd->val = intFU->imm + 0;	
-			else if(strcmp(intFU->opcode, "ADD") == 0) u_rd->val = intFU->u_rs1_val + intFU->u_rs2_val;
-			else if(strcmp(intFU->opcode, "SUB") == 0) u_rd->val = intFU->u_rs1_val - intFU->u_rs2_val;
-			else if(strcmp(intFU->opcode, "AND") == 0) u_rd->val = intFU->u_rs1_val & intFU->u_rs2_val;
-			else if(strcmp(intFU->opcode, "OR") == 0) u_rd->val = intFU->u_rs1_val | intFU->u_rs2_val;	
-			else if(strcmp(intFU->opcode, "XOR") == 0) u_rd->val = intFU->u_rs1_val ^ intFU->u_rs2_val;	
-			else if(strcmp(intFU->opcode, "ADDL") == 0) u_rd->val = intFU->u_rs1_val + intFU->imm;
-			else if(strcmp(intFU->opcode, "SUBL") == 0) u_rd->val = intFU->u_rs1_val - intFU->imm;		
-				
-			else if(is_controlflow(intFU->opcode)) {
-				
-				char take_branch = 0;	
-				if(strcmp(intFU->opcode, "JUMP") == 0 || strcmp(intFU->opcode, "JAL") == 0) {
-					take_branch = 1;
-					cpu->pc = intFU->u_rs1_val + intFU->imm;
+// intFU or the AGU ; ALU work, memory addresses and branch decisions
+static void int_execute(cpu_t* cpu, fu_pool_t* pool) {
+
+	for(int f=0; f<pool->units * pool->depth; f++) {
+		fu_t* intFU = &pool->slots[f];
+		intFU->busy--;
+		if(!intFU->busy) {
+
+			rob_entry_t* robe = &cpu->rob.entries[intFU->rob_idx];	
+			ureg_t* u_rd = &cpu->unified_regs[robe->u_rd];
+			// perform computation
+			if(is_mem(intFU->opcode)) { // memory address computation
+				lsq_entry_t* lsqe = &cpu->lsq.entries[robe->lsq_idx];
+				lsqe->mem_addr = intFU->u_rs1_val + intFU->imm;
+				lsqe->mem_addr_valid = 1;
+				if(intFU->opcode == OP_STORE && cpu->config.load_issue == LOAD_SPECULATIVE) order_check(cpu, robe->lsq_idx);
+			} else { // arithmetic insn	
+				switch(intFU->opcode) {
+					case OP_MOVC: u_rd->val = intFU->imm + 0; break;
+					case OP_ADD: u_rd->val = intFU->u_rs1_val + intFU->u_rs2_val; break;
+					case OP_SUB: u_rd->val = intFU->u_rs1_val - intFU->u_rs2_val; break;
+					case OP_AND: u_rd->val = intFU->u_rs1_val & intFU->u_rs2_val; break;
+					case OP_OR: u_rd->val = intFU->u_rs1_val | intFU->u_rs2_val; break;
+					case OP_XOR: u_rd->val = intFU->u_rs1_val ^ intFU->u_rs2_val; break;
+					case OP_ADDL: u_rd->val = intFU->u_rs1_val + intFU->imm; break;
+					case OP_SUBL: u_rd->val = intFU->u_rs1_val - intFU->imm; break;
+					default: break;
 				}
-				if(strcmp(intFU->opcode, "BZ") == 0 && intFU->zero_flag) {
-					take_branch = 1;
-					cpu->pc = intFU->pc + intFU->imm;
-				}			
-				if(strcmp(intFU->opcode, "BNZ") == 0 && !intFU->zero_flag) {
-					take_branch = 1;
-					cpu->pc = intFU->pc + intFU->imm;
-				}	
 				
-				if(take_branch) {
+				if(is_controlflow(intFU->opcode)) {
 				
-					// restores saved state
-					memcpy(cpu->unified_regs, cpu->saved_state[cpu->cfid].unified_regs, NUM_UNIFIED_REGS * sizeof(ureg_t));
-					memcpy(cpu->front_rename_table, cpu->saved_state[cpu->cfid].front_rename_table, (NUM_ARCH_REGS+1) * sizeof(int)); // +1 for zero-flag
-			
-					if(strcmp(intFU->opcode, "JAL") == 0) {
-						u_rd->val = intFU->pc + 4; // return address
+					char take_branch = 0;	
+					int next_pc = intFU->pc + 4;
+					if(intFU->opcode == OP_JUMP || intFU->opcode == OP_JAL) {
+						take_branch = 1;
+						next_pc = intFU->u_rs1_val + intFU->imm;
 					}
-
-					// search where this cfid starts in the cfq
-					int temp_head_ptr = 0;
-					for(int i=cpu->cfq_head_ptr; i<CFQ_SIZE; i++) {
-						if(cpu->cfq[i] == intFU->cfid) {
-							temp_head_ptr = i;
-							break;
+					if(intFU->opcode == OP_BZ && intFU->zero_flag) {
+						take_branch = 1;
+						next_pc = intFU->pc + intFU->imm;
+					}			
+					if(intFU->opcode == OP_BNZ && !intFU->zero_flag) {
+						take_branch = 1;
+						next_pc = intFU->pc + intFU->imm;
+					}	
+
+					bpred_info_t* pred = &cpu->saved_state[intFU->cfid].pred;
+					int kind = branch_kind(intFU->opcode);
+					bpred_update(&cpu->bpred, intFU->pc, kind, take_branch, next_pc, pred);
+				
+					if(take_branch != pred->taken || next_pc != pred->next_pc) { // fetch went the wrong way
+						cpu->pc = next_pc;
+						bpred_recover(&cpu->bpred, intFU->pc, kind, take_branch, pred);
+						cpu->perf.flushes++;
+				
+						// restores saved state ; values already written to the URF stay
+						ureg_rewind(cpu, cpu->saved_state[intFU->cfid].free_head);
+						memcpy(cpu->front_rename_table, cpu->saved_state[intFU->cfid].front_rename_table, (NUM_ARCH_REGS+1) * sizeof(int)); // +1 for zero-flag
+
+						// free the cfids of younger branches at once ; the branch keeps its cfid until it commits
+						int new_tail_ptr = (cfq_find(cpu, intFU->cfid) + 1) % cpu->config.cfq_size;
+						for(int p=new_tail_ptr; p!=cpu->cfq_tail_ptr; p=(p+1)%cpu->config.cfq_size) {
+							bitmap_set(cpu->cfid_free, cpu->cfq[p]);
+							branch_resolve(cpu, cpu->cfq[p]);
+							cpu->cfq_num--;
 						}
-					}
+						cpu->cfq_tail_ptr = new_tail_ptr;
 
-					// flush all instructions with cfids from temp_head_ptr to cfq_tail_ptr
-					int new_tail_ptr = temp_head_ptr; // save the value
-					while(temp_head_ptr != cpu->cfq_tail_ptr) {	
-						// convert all insn with matching cfid to NOPs
-						int cfid = cpu->cfq[temp_head_ptr];
+						// everything dispatched after this branch is on its path ; one AND of its row with the entries in use per queue
 						// search iq
-						iq_entry_t* iq = cpu->iq;
-						for(int i=0; i<IQ_SIZE; i++) {
-							iq_entry_t* iqe = &iq[i];
-							if(!iqe->taken) continue;
-			
-							if(iqe->cfid == cfid) {
-								iqe->taken = 0;	// deallocate entry
-							}	
+						int iq_size = cpu->config.iq_size;
+						const uint64_t* match = branch_path(cpu, cpu->iq_brmask, iq_size, cpu->iq_free, 1, intFU->cfid);
+						for(int i=bitmap_first(match, iq_size); i!=-1; i=bitmap_next(match, iq_size, i+1)) {
+							iq_release(cpu, i); // deallocate entry
 						}
 						// search rob
-						rob_entry_t* rob = cpu->rob.entries;
-						for(int i=0; i<ROB_SIZE; i++) {
-							if(intFU->rob_idx == i) continue; // do not flush this insn
-							rob_entry_t* robe = &rob[i];
-							if(robe->taken && robe->cfid == cfid) {
-								strcpy(robe->opcode, "NOP");
-								robe->valid = 1; // no need to wait for sources
-			
-								// update print info
-								strcpy(cpu->print_info[get_code_index(robe->pc)].opcode, "NOP");
-
+						match = branch_path(cpu, cpu->rob.brmask, cpu->rob.size, cpu->rob.taken, 0, intFU->cfid);
+						for(int i=bitmap_first(match, cpu->rob.size); i!=-1; i=bitmap_next(match, cpu->rob.size, i+1)) {
+							rob_entry_t* robe = &cpu->rob.entries[i];
+							if(!is_nop(robe->opcode)) {
+								cpu->perf.squashed++;
+								trace_insn(cpu, TR_SQUASH, robe->seq, robe->pc, robe->opcode, i, -1, robe->lsq_idx, cpu->rob.cfid[i]);
 							}
+							robe->opcode = OP_NOP;
+							robe->valid = 1; // no need to wait for sources
+	
+							// update print info
+							if(!cpu->batch) cpu->print_info[get_code_index(robe->pc)].opcode = OP_NOP;
 						}
 
 						// search lsq
-						lsq_entry_t* lsq = cpu->lsq.entries;
-						for(int i=0; i<LSQ_SIZE; i++) {
-							lsq_entry_t* lsqe = &lsq[i];
-							if(lsqe->taken && lsqe->cfid == cfid) {
-								strcpy(lsqe->opcode, "NOP");
-								lsqe->done= 1; // no need to wait for sources
-			
-								// update print info
-								strcpy(cpu->print_info[get_code_index(lsqe->pc)].opcode, "NOP");
-							}
+						match = branch_path(cpu, cpu->lsq.brmask, cpu->lsq.size, cpu->lsq.taken, 0, intFU->cfid);
+						for(int i=bitmap_first(match, cpu->lsq.size); i!=-1; i=bitmap_next(match, cpu->lsq.size, i+1)) {
+							lsq_entry_t* lsqe = &cpu->lsq.entries[i];
+							lsqe->opcode = OP_NOP;
+							lsqe->done= 1; // no need to wait for sources
+	
+							// update print info
+							if(!cpu->batch) cpu->print_info[get_code_index(lsqe->pc)].opcode = OP_NOP;
 						}
 
-						// check FUs
-						if(cpu->mulFU.cfid == cfid) {
-							cpu->mulFU.busy = -1; // free resource
-							strcpy(cpu->mulFU.opcode, "NOP");	
-						}
-						if(cpu->memFU.cfid == cfid) {
-							cpu->memFU.busy = -1; // free resource
-							strcpy(cpu->memFU.opcode, "NOP");	
+						// check FUs ; an insn in flight there still has its ROB entry
+						const uint64_t* rob_path = brmask_row(cpu->rob.brmask, cpu->rob.size, intFU->cfid);
+						for(int t=0; t<NUM_FU_TYPES; t++) {
+							fu_pool_t* pool = &cpu->fu[t];
+							for(int j=0; j<pool->units * pool->depth; j++) {
+								fu_t* fu = &pool->slots[j];
+								if(fu->busy > 0 && bitmap_test(rob_path, fu->rob_idx)) {
+									fu->busy = -1; // free resource
+									fu->opcode = OP_NOP;	
+								}
+							}
 						}
-			
-						// flush the decode and dispatch stage, if cfid match
-						if(cpu->stage[F].cfid == cfid) {
-							strcpy(cpu->stage[F].opcode, "NOP");
-							cpu->stage[F].busy = 1; // let NOP sit for 1 cycle
+						for(int j=0; j<cpu->mem_slots; j++) {
+							fu_t* fu = &cpu->memFU[j];
+							if(fu->busy > 0 && fu->opcode == OP_LOAD && bitmap_test(rob_path, fu->rob_idx)) { // a STORE in memFU already committed ; its ROB entry may be reused
+								fu->busy = -1; // free resource
+								fu->opcode = OP_NOP;	
+							}
 						}
-						if(cpu->stage[DRF].cfid == cfid) {
-							strcpy(cpu->stage[DRF].opcode, "NOP");
+
+						cpu->cfid = intFU->cfid; // insn fetched from the target belong to this branch
+
+						// everything in the front-end is younger than this branch ; flush the fetch, decode and dispatch latches
+						for(int i=DRF; i<=DP; i++) { // the fetch latch only holds a copy of what decode has
+							for(int j=0; j<cpu->stage[i].count; j++) {
+								stage_t* stage = &cpu->stage[i].slots[j];
+								if(!is_valid_insn(stage->opcode)) continue;
+								cpu->perf.squashed++;
+								trace_insn(cpu, TR_SQUASH, stage->seq, stage->pc, stage->opcode, -1, -1, -1, -1);
+							}
 						}
-						if(cpu->stage[DP].cfid == cfid) {
-							strcpy(cpu->stage[DP].opcode, "NOP");
+						for(int i=F; i<=DP; i++) {
+							cpu->stage[i].count = 0;
+							cpu->stage[i].stalled = 0; // un-stall stages if it fetched insn past code 
 						}
-						
-						// un-stall stages if it fetched insn past code 
-						cpu->stage[F].stalled = 0;
-						cpu->stage[DRF].stalled = 0;
-						cpu->stage[DP].stalled = 0;	
-					
-						// free this cfid
-						cpu->cfid_freelist[cfid] = 0;	
-						cpu->cfid = -1; // not sure...
-						temp_head_ptr = (temp_head_ptr + 1) % CFQ_SIZE;
-					
-					} // convert matching cfid to NOPs ; end
-
-					cpu->cfq_tail_ptr = new_tail_ptr;
-				} // if taken_branch ;  end
-				else { // not taken branch
-					// free this cfid
-					cpu->cfid_freelist[intFU->cfid] = 0;		
-					cpu->cfid = -1; // not sure...
-				}
+						cpu->stage[F].busy = 1; // let NOP sit for 1 cycle
+					} // mispredicted ;  end
+					// a correctly predicted branch keeps its cfid until it commits ; an older branch can still flush the insn after it
+					branch_resolve(cpu, intFU->cfid);
+
+					if(intFU->opcode == OP_JAL) {
+						u_rd->val = intFU->pc + 4; // return address ; after the restore, which would overwrite it
+					}
 	
-				//robe->valid = 1;	
-			} // controlflow insns ; end 
-
-			if(has_rd(intFU->opcode) && !is_mem(intFU->opcode)) {
-				u_rd->valid = 1;	
-				if(strcmp(intFU->opcode, "MOVC") && strcmp(intFU->opcode, "JAL")) u_rd->zero_flag = (u_rd->val == 0);
-				// broadcast ready value to IQ and LSQ
-				broadcast(cpu, robe->u_rd, u_rd->val);
-			}
-			if(has_rd(intFU->opcode) && !is_mem(intFU->opcode) && intFU->cfid != cpu->cfid) { // valid path, update saved state
-				cpu->saved_state[cpu->cfid].unified_regs[robe->u_rd].valid = 1;
-				cpu->saved_state[cpu->cfid].unified_regs[robe->u_rd].val = u_rd->val;
-				cpu->saved_state[cpu->cfid].unified_regs[robe->u_rd].zero_flag = u_rd->zero_flag;
-			}
+					//robe->valid = 1;	
+				} // controlflow insns ; end 
+
+				if(has_rd(intFU->opcode) && !is_mem(intFU->opcode)) {
+					u_rd->valid = 1;	
+					if(sets_zero_flag(intFU->opcode) && intFU->opcode != OP_JAL) u_rd->zero_flag = (u_rd->val == 0); // JAL claims the zero-flag in rename but leaves it cleared
+					// broadcast ready value to IQ and LSQ
+					broadcast(cpu, robe->u_rd, u_rd->val);
+				}
 
-			robe->valid = 1;	
-		}
+				robe->valid = 1;	
+				trace_insn(cpu, TR_COMPLETE, intFU->seq, intFU->pc, intFU->opcode, intFU->rob_idx, -1, -1, intFU->cfid);
+			}
 				
-		update_print_stack("Execute", cpu, intFU->print_idx);		
+			update_print_stack("Execute", cpu, intFU->print_idx);		
+		}
+		if(intFU->busy < 0) intFU->print_idx = cpu->code_size; // set to NOP if empty
 	}
-	if(intFU->busy < 0) intFU->print_idx = cpu->code_size; // set to NOP if empty
- 
+}
+
+int execute(cpu_t* cpu) {
+
+	issue(cpu); // selects an instruction that is ready
+
+	// check each FU
+	int_execute(cpu, &cpu->fu[FU_INT]);
+	int_execute(cpu, &cpu->fu[FU_AGU]);
+
 	// mulFU
-	fu_t* mulFU = &cpu->mulFU;
-	mulFU->busy--;
-	if(!mulFU->busy) {
-		rob_entry_t* robe = &cpu->rob.entries[mulFU->rob_idx];	
+	fu_pool_t* pool = &cpu->fu[FU_MUL];
+	for(int f=0; f<pool->units * pool->depth; f++) {
+		fu_t* mulFU = &pool->slots[f];
+		mulFU->busy--;
+		if(!mulFU->busy) {
+			rob_entry_t* robe = &cpu->rob.entries[mulFU->rob_idx];	
 		
-		ureg_t* u_rd = &cpu->unified_regs[robe->u_rd];
-		u_rd->val = mulFU->u_rs1_val * mulFU->u_rs2_val; // the value is written directly to URF
-		u_rd->valid = 1;
-		if(u_rd->val == 0) u_rd->zero_flag = 1;
-		if(mulFU->cfid != cpu->cfid) { // valid path, update saved state
-			cpu->saved_state[cpu->cfid].unified_regs[robe->u_rd].valid = 1;
-			cpu->saved_state[cpu->cfid].unified_regs[robe->u_rd].val = u_rd->val;
-			cpu->saved_state[cpu->cfid].unified_regs[robe->u_rd].zero_flag = u_rd->zero_flag;
+			ureg_t* u_rd = &cpu->unified_regs[robe->u_rd];
+			u_rd->val = mulFU->u_rs1_val * mulFU->u_rs2_val; // the value is written directly to URF
+			u_rd->valid = 1;
+			if(u_rd->val == 0) u_rd->zero_flag = 1;
+
+			// broadcast ready value to IQ
+			broadcast(cpu, robe->u_rd, u_rd->val);
+			robe->valid = 1;
+			trace_insn(cpu, TR_COMPLETE, mulFU->seq, robe->pc, mulFU->opcode, mulFU->rob_idx, -1, -1, mulFU->cfid);
+
+			update_print_stack("Execute", cpu, mulFU->print_idx);		
 		}
+		if(mulFU->busy < 0) mulFU->print_idx = cpu->code_size; // set to NOP if empty
+	}
 
-		// broadcast ready value to IQ
-		broadcast(cpu, robe->u_rd, u_rd->val);
-		robe->valid = 1;
+	return 0;
+}
+
+// memFU ports ; the first load_ports take LOADs, and STOREs too unless there are store ports after them
+static char port_takes(cpu_t* cpu, int port, opcode_t opcode) {
+	if(port < cpu->config.load_ports) return opcode == OP_LOAD || !cpu->config.store_ports;
+	return opcode == OP_STORE;
+}
 
-		update_print_stack("Execute", cpu, mulFU->print_idx);		
+// a free slot of this port ; -1 if the port cannot start anything this cycle
+static int port_slot(cpu_t* cpu, int port) {
+	for(int s=port; s<cpu->mem_slots; s+=cpu->mem_ports) {
+		if(cpu->memFU[s].busy < 0) return s;
 	}
-	if(mulFU->busy < 0) mulFU->print_idx = cpu->code_size; // set to NOP if empty
+	return -1;
+}
 
+// an access still on its way ; HALT waits for these
+static char mem_in_flight(cpu_t* cpu) {
+	for(int s=0; s<cpu->mem_slots; s++) {
+		if(cpu->memFU[s].busy > 0 && !is_nop(cpu->memFU[s].opcode)) return 1;
+	}
 	return 0;
 }
 
-int memory(cpu_t* cpu) {
+// sends the LSQ entry to a memFU slot for lat cycles
+static void mem_start(cpu_t* cpu, int slot, int lsq_idx, int lat) {
+	fu_t* memFU = &cpu->memFU[slot];
+	lsq_entry_t* lsqe = &cpu->lsq.entries[lsq_idx];
+	rob_entry_t* robe = &cpu->rob.entries[lsqe->rob_idx];
+	memFU->opcode = lsqe->opcode;
+	memFU->pc = lsqe->pc;
+	memFU->mem_addr = lsqe->mem_addr;
+	memFU->u_rs2_val = lsqe->u_rs2_val;	// only used by stores
+	memFU->forwarded = 0;
+	memFU->rob_idx = lsqe->rob_idx;
+	memFU->lsq_idx = lsq_idx;
+	memFU->busy = lat - 1; // this cycle also counts toward the latency count, hence -1
+	memFU->cfid = cpu->lsq.cfid[lsq_idx];
+	memFU->u_rd = robe->u_rd;
+	memFU->rd = robe->rd; // used by loads to free physical register when complete
+	memFU->seq = robe->seq;
+	lsqe->issued = 1;
+	trace_insn(cpu, TR_MEMORY, robe->seq, lsqe->pc, lsqe->opcode, lsqe->rob_idx, -1, lsq_idx, cpu->lsq.cfid[lsq_idx]);
+	// print info
+	memFU->print_idx = get_code_index(lsqe->pc);
+}
+
+// the ROB head is a LOAD or STORE outside memory ; it is on the right path by now, so the run stops here
+static void mem_fault(cpu_t* cpu) {
+	int head_ptr = cpu->rob.head_ptr;
+	rob_entry_t* robe = &cpu->rob.entries[head_ptr];
+	if(!bitmap_test(cpu->rob.taken, head_ptr) || !is_mem(robe->opcode)) return;
+	lsq_entry_t* lsqe = &cpu->lsq.entries[robe->lsq_idx];
+	if(!lsqe->mem_addr_valid || mem_addr_ok(cpu, lsqe->mem_addr)) return;
+	fprintf(stderr, "sim> %s at pc %d accesses address %d outside memory (mem_size %d) ; stopping at %d cycles\n", opcode_names[robe->opcode], robe->pc, lsqe->mem_addr, cpu->config.mem_size, cpu->clock);
+	cpu->fault = 1;
+}
+
+// the LSQ head, when it waits for the ROB head and is ready ; STOREs always go from here, LOADs only with load_issue inorder
+static lsq_entry_t* mem_head(cpu_t* cpu) {
+	lsq_entry_t* lsqe = &cpu->lsq.entries[cpu->lsq.head_ptr];
+	rob_entry_t* robe = &cpu->rob.entries[cpu->rob.head_ptr];
+	if(!bitmap_test(cpu->lsq.taken, cpu->lsq.head_ptr) || !lsqe->mem_addr_valid || lsqe->issued || lsqe->pc != robe->pc) return NULL;
+	if(!mem_addr_ok(cpu, lsqe->mem_addr)) return NULL; // never goes ; mem_fault() stops the run
+	if(lsqe->opcode == OP_STORE && lsqe->u_rs2_ready) return lsqe;
+	if(lsqe->opcode == OP_LOAD && cpu->config.load_issue == LOAD_INORDER) return lsqe;
+	return NULL;
+}
+
+// the access in slot completes this cycle
+static void mem_complete(cpu_t* cpu, fu_t* memFU) {
+
+	//int head_ptr = cpu->lsq.head_ptr;
+	//lsq_entry_t* lsqe = &cpu->lsq.entries[head_ptr];
+
+	ureg_t* u_rd = &cpu->unified_regs[memFU->u_rd];
+
+	if(memFU->opcode == OP_LOAD) {
+		u_rd->val = memFU->forwarded ? memFU->u_rs2_val : cpu->memory[memFU->mem_addr];
+		int seq = -1;
+		for(int s=0; s<cpu->mem_slots && !memFU->forwarded; s++) { // committed STOREs still on their way are all older ; the youngest one to this address wins
+			fu_t* store = &cpu->memFU[s];
+			if(store->busy > 0 && store->opcode == OP_STORE && store->mem_addr == memFU->mem_addr && store->seq > seq) {
+				u_rd->val = store->u_rs2_val;
+				seq = store->seq;
+			}
+		}
+		u_rd->valid = 1;
+
+		// broadcast ready value to IQ
+		broadcast(cpu, memFU->u_rd, u_rd->val);
 	
-	fu_t* memFU = &cpu->memFU;
-	memFU->busy--;
-	if(memFU->busy < 0) { // unit is free ; put a memory instruction here
+		if(cpu->config.load_issue == LOAD_INORDER) { // remove LOAD from lsq 
+			int head_ptr = cpu->lsq.head_ptr;
+			bitmap_clear(cpu->lsq.taken, head_ptr);
+			wait_remove(cpu, lsq_wait_node(cpu, head_ptr));
+			cpu->lsq.head_ptr = (cpu->lsq.head_ptr + 1) % cpu->lsq.size;
+		} else cpu->lsq.entries[memFU->lsq_idx].done = 1; // stays until it commits ; older STOREs still check it
 		
-		memFU->print_idx = cpu->code_size; // NOP	
+		rob_entry_t* robe = &cpu->rob.entries[memFU->rob_idx];
+		robe->valid = 1;	
+	}
+	else if(memFU->opcode == OP_STORE) {
+		cpu->memory[memFU->mem_addr] = memFU->u_rs2_val;
+	}
+	if(!is_nop(memFU->opcode)) trace_insn(cpu, TR_COMPLETE, memFU->seq, memFU->pc, memFU->opcode, -1, -1, -1, memFU->cfid);
+	cpu->print_memory = 1; // print memory contents since mem has been updated
+}
+
+int memory(cpu_t* cpu) {
 	
-		// check head of LSQ for ready instruction 
-		int head_ptr = cpu->lsq.head_ptr;
-		lsq_entry_t* lsqe = &cpu->lsq.entries[head_ptr];
-		//if(lsqe->done) return 0; // this memory instruction completed ; just needs to be commited
+	for(int s=0; s<cpu->mem_slots; s++) {
+		cpu->memFU[s].busy--;
+	}
+	if(!cpu->fault) mem_fault(cpu);
+
+	// count it if the LSQ head could have started this cycle but every port for it is taken
+	lsq_entry_t* head = mem_head(cpu);
+	if(head) {
+		char port_free = 0;
+		for(int p=0; p<cpu->mem_ports; p++) {
+			if(port_takes(cpu, p, head->opcode) && port_slot(cpu, p) != -1) port_free = 1;
+		}
+		if(!port_free) cpu->perf.stalls[STALL_MEM_FU]++;
+	}
 
-		head_ptr = cpu->rob.head_ptr;
-		rob_entry_t* robe = &cpu->rob.entries[head_ptr];
+	// each port starts at most one access
+	for(int p=0; p<cpu->mem_ports; p++) {
+		int slot = port_slot(cpu, p);
+		if(slot == -1) continue;
+		fu_t* memFU = &cpu->memFU[slot];
 
 		// check if source is ready (for store only)
-		if(cpu->unified_regs[lsqe->u_rs2].valid) {
+		lsq_entry_t* lsqe = &cpu->lsq.entries[cpu->lsq.head_ptr];
+		if(lsqe->u_rs2 != -1 && cpu->unified_regs[lsqe->u_rs2].valid) {
 			lsqe->u_rs2_val = cpu->unified_regs[lsqe->u_rs2].val;
 			lsqe->u_rs2_ready = 1;	
 		}
 
-		if(lsqe->taken && lsqe->mem_addr_valid && lsqe->pc == robe->pc) {
-			char ready = 0;
-			if(strcmp(lsqe->opcode, "LOAD") == 0) ready = 1;
-			else if(strcmp(lsqe->opcode, "STORE") == 0 && lsqe->u_rs2_ready) ready = 1;
-
-			if(ready) { // send to memFU	
-				strcpy(memFU->opcode, lsqe->opcode);
-				memFU->pc = lsqe->pc;
-				memFU->mem_addr = lsqe->mem_addr;
-				memFU->u_rs2_val = lsqe->u_rs2_val;	// only used by stores
-				//memFU->rob_idx = lsqe->rob_idx;
-				memFU->busy = MEM_FU_LAT - 1; // this cycle also counts toward the latency count, hence -1
-				memFU->cfid = lsqe->cfid;
-				memFU->u_rd = robe->u_rd;
-				memFU->rd = robe->rd; // used by loads to free physical register when complete
-				// print info
-				memFU->print_idx = get_code_index(lsqe->pc);
-			
-				// commit the STORE ; remove entry from LSQ and ROB only for a STORE (since nothing depends on STORE)
-				if(strcmp(lsqe->opcode, "STORE") == 0) {
-					int head_ptr = cpu->lsq.head_ptr;
-					cpu->lsq.entries[head_ptr].taken = 0;
-					cpu->lsq.head_ptr = (cpu->lsq.head_ptr + 1) % LSQ_SIZE;
-					
-					head_ptr = cpu->rob.head_ptr;
-					cpu->rob.entries[head_ptr].taken = 0;
-					cpu->rob.head_ptr = (cpu->rob.head_ptr + 1) % ROB_SIZE;
-	
-					update_print_stack("Commit", cpu, memFU->print_idx);
-					//update_print_stack("Memory", cpu, memFU->print_idx);
+		lsqe = mem_head(cpu);
+		if(lsqe && port_takes(cpu, p, lsqe->opcode)) {
+			int lat = cpu->config.mem_fu_lat;
+			if(cpu->cache.levels) {
+				lat = cache_access(&cpu->cache, lsqe->mem_addr, lsqe->opcode == OP_STORE, cpu->clock);
+				if(lat < 0) { // every MSHR busy ; try again next cycle
+					cpu->perf.stalls[STALL_MSHR]++;
+					break;
 				}
 			}
-		}
-	
-	} else if(!memFU->busy) { // mem operation complete in this cycle
-
-		//int head_ptr = cpu->lsq.head_ptr;
-		//lsq_entry_t* lsqe = &cpu->lsq.entries[head_ptr];
 
-		//head_ptr = cpu->rob.head_ptr;
-		//rob_entry_t* robe = &cpu->rob.entries[memFU->u_rd];
-		ureg_t* u_rd = &cpu->unified_regs[memFU->u_rd];
-		// assert(robe->pc == lsqe->pc);
-
-		if(strcmp(memFU->opcode, "LOAD") == 0) {
-			u_rd->val = cpu->memory[memFU->mem_addr];
-			u_rd->valid = 1;
-
-			// update architectural register file
-			//cpu->arch_regs[memFU->rd].u_rd = memFU->u_rd;
-
-			//// update backend rename table ; memory insn ROB entries were removed earlier, so rename table update must be done here
-			//int old_u_rd = cpu->back_rename_table[memFU->rd];
-			//if(old_u_rd != -1 && old_u_rd != memFU->u_rd) cpu->unified_regs[old_u_rd].taken = 0; // free old mapping
-			//cpu->back_rename_table[memFU->rd] = memFU->u_rd;
-
-			// broadcast ready value to IQ
-			broadcast(cpu, memFU->u_rd, u_rd->val);
+			mem_start(cpu, slot, cpu->lsq.head_ptr, lat);
 		
-			// remove LOAD from lsq 
-			int head_ptr = cpu->lsq.head_ptr;
-			cpu->lsq.entries[head_ptr].taken = 0;
-			cpu->lsq.head_ptr = (cpu->lsq.head_ptr + 1) % LSQ_SIZE;
-			
-			rob_entry_t* robe = &cpu->rob.entries[cpu->rob.head_ptr];
-			//assert(robe->pc == memFU->pc);
-			robe->valid = 1;	
-	
-			//head_ptr = cpu->rob.head_ptr;
-			//cpu->rob.entries[head_ptr].taken = 0;
-			//cpu->rob.head_ptr = (cpu->rob.head_ptr + 1) % ROB_SIZE;
-	
-			//update_print_stack("Commit", cpu, memFU->print_idx);
-			//update_print_stack("Memory", cpu, memFU->print_idx);
+			// commit the STORE ; remove entry from LSQ and ROB only for a STORE (since nothing depends on STORE)
+			if(lsqe->opcode == OP_STORE) {
+				rob_entry_t* robe = &cpu->rob.entries[cpu->rob.head_ptr];
+				cpu->committed++;
+				cpu->perf.committed[CLS_STORE]++;
+				trace_insn(cpu, TR_COMMIT, robe->seq, lsqe->pc, lsqe->opcode, cpu->rob.head_ptr, -1, cpu->lsq.head_ptr, cpu->lsq.cfid[cpu->lsq.head_ptr]);
+				int head_ptr = cpu->lsq.head_ptr;
+				bitmap_clear(cpu->lsq.taken, head_ptr);
+				wait_remove(cpu, lsq_wait_node(cpu, head_ptr));
+				cpu->lsq.head_ptr = (cpu->lsq.head_ptr + 1) % cpu->lsq.size;
+				
+				head_ptr = cpu->rob.head_ptr;
+				bitmap_clear(cpu->rob.taken, head_ptr);
+				cpu->rob.head_ptr = (cpu->rob.head_ptr + 1) % cpu->rob.size;
+
+				update_print_stack("Commit", cpu, memFU->print_idx);
+			}
+			continue;
+		}
 
+		// nothing from the head ; the oldest LOAD whose older STOREs allow it
+		if(cpu->config.load_issue == LOAD_INORDER || !port_takes(cpu, p, OP_LOAD)) continue;
+		int fwd_idx;
+		int lsq_idx = load_select(cpu, &fwd_idx);
+		if(lsq_idx == -1) continue;
+		lsq_entry_t* load = &cpu->lsq.entries[lsq_idx];
+		int lat = 1; // straight from the STORE's LSQ entry
+		if(fwd_idx == -1) lat = cpu->cache.levels ? cache_access(&cpu->cache, load->mem_addr, 0, cpu->clock) : cpu->config.mem_fu_lat;
+		if(lat < 0) {
+			cpu->perf.stalls[STALL_MSHR]++;
+			break;
 		}
-		else if(strcmp(memFU->opcode, "STORE") == 0) {
-			cpu->memory[memFU->mem_addr] = memFU->u_rs2_val;
+		mem_start(cpu, slot, lsq_idx, lat);
+		load->fwd_idx = fwd_idx;
+		if(fwd_idx != -1) {
+			memFU->forwarded = 1;
+			memFU->u_rs2_val = cpu->lsq.entries[fwd_idx].u_rs2_val;
+			cpu->perf.forwarded++;
 		}
-		cpu->print_memory = 1; // print memory contents since mem has been updated
-		//robe->valid = 1;		
-		//lsqe->done = 1;
-	
-//		update_print_stack("Memory", cpu, memFU->print_idx);
 	}
 
-	update_print_stack("Memory", cpu, memFU->print_idx);
+	// mem operations complete in this cycle, the ones just started if they take a single cycle ; STOREs first so LOADs see memory up to date
+	for(int s=0; s<cpu->mem_slots; s++) {
+		if(!cpu->memFU[s].busy && cpu->memFU[s].opcode == OP_STORE) mem_complete(cpu, &cpu->memFU[s]);
+	}
+	for(int s=0; s<cpu->mem_slots; s++) {
+		if(!cpu->memFU[s].busy && cpu->memFU[s].opcode != OP_STORE) mem_complete(cpu, &cpu->memFU[s]);
+	}
+
+	// one line per port ; the access it started last
+	for(int p=0; p<cpu->mem_ports; p++) {
+		int print_idx = cpu->code_size; // NOP
+		int busy = -1;
+		for(int s=p; s<cpu->mem_slots; s+=cpu->mem_ports) {
+			if(cpu->memFU[s].busy > busy) {
+				busy = cpu->memFU[s].busy;
+				print_idx = cpu->memFU[s].print_idx;
+			}
+		}
+		update_print_stack("Memory", cpu, print_idx);
+	}
 
 	return 0;
 }
 
 int commit(cpu_t* cpu) {
 	
-	for(int i=0; i<MAX_COMMIT_NUM; i++) {		
+	for(int i=0; i<cpu->config.max_commit_num; i++) {		
 		int ptr = cpu->rob.head_ptr;
 		// release ROB entry
 		// get ROB entry at the head of ROB
 		rob_entry_t* robe = &cpu->rob.entries[ptr];
-		if(robe->taken && robe->valid) { // insn has wrote to URF 
+		if(bitmap_test(cpu->rob.taken, ptr) && robe->valid) { // insn has wrote to URF 
 			
+			if(robe->opcode == OP_LOAD && cpu->config.load_issue != LOAD_INORDER) { // it kept its LSQ entry, now at the head
+				if(cpu->lsq.entries[robe->lsq_idx].violated) {
+					order_flush(cpu);
+					break;
+				}
+				bitmap_clear(cpu->lsq.taken, robe->lsq_idx);
+				cpu->lsq.head_ptr = (cpu->lsq.head_ptr + 1) % cpu->lsq.size;
+			}
 			if(has_rd(robe->opcode)) {
 				// set arch reg mapping to URF
 				cpu->arch_regs[robe->rd].u_rd = robe->u_rd;
 				
 				// update backend rename table
 				int old_u_rd = cpu->back_rename_table[robe->rd];
-				if(old_u_rd != -1 && old_u_rd != robe->u_rd) cpu->unified_regs[old_u_rd].taken = 0; // free old mapping
 				cpu->back_rename_table[robe->rd] = robe->u_rd;
-				if(!is_mem(robe->opcode) && strcmp(robe->opcode, "MOVC")) {
-					//int old_u_rd = cpu->back_rename_table[ZERO_FLAG];
-					//if(old_u_rd != -1 && old_u_rd != robe->u_rd) cpu->unified_regs[old_u_rd].taken = 0;
+				if(old_u_rd != -1 && old_u_rd != robe->u_rd && !ureg_committed(cpu, old_u_rd)) ureg_release(cpu, old_u_rd); // free old mapping
+				if(sets_zero_flag(robe->opcode)) {
+					int old_zf = cpu->back_rename_table[ZERO_FLAG];
 					cpu->back_rename_table[ZERO_FLAG] = robe->u_rd; 
+					if(old_zf != -1 && old_zf != robe->u_rd && !ureg_committed(cpu, old_zf)) ureg_release(cpu, old_zf);
 				}
 			} 
 			//if(is_mem(robe->opcode)) {
-			//	cpu->lsq.entries[cpu->lsq.head_ptr].taken = 0;
-			//	cpu->lsq.head_ptr = (cpu->lsq.head_ptr + 1) % LSQ_SIZE; // update lsq head_ptr	
+			//	bitmap_clear(cpu->lsq.taken, cpu->lsq.head_ptr);
+			//	cpu->lsq.head_ptr = (cpu->lsq.head_ptr + 1) % cpu->lsq.size; // update lsq head_ptr	
 			//}	
 			if(is_halt(robe->opcode)) {
 				// mem insn leave ROB but can be in the middle of a mem access ; wait until done	
-				if(cpu->memFU.busy <= 0) cpu->done = 1;
+				if(!mem_in_flight(cpu)) cpu->done = 1;
 			}
 
-			robe->taken = 0;
-			cpu->rob.head_ptr = (cpu->rob.head_ptr + 1) % ROB_SIZE; // update rob head_ptr		
+			if(is_controlflow(robe->opcode)) cfid_retire(cpu, cpu->rob.cfid[ptr]);
+			if(is_nop(robe->opcode) && robe->lsq_idx != -1) { // flushed LOAD or STORE ; its LSQ entry is at the head, behind every older mem insn
+				bitmap_clear(cpu->lsq.taken, robe->lsq_idx);
+				wait_remove(cpu, lsq_wait_node(cpu, robe->lsq_idx));
+				cpu->lsq.head_ptr = (cpu->lsq.head_ptr + 1) % cpu->lsq.size;
+			}
+
+			if(!is_nop(robe->opcode)) { // flushed insn were turned into NOPs
+				trace_insn(cpu, TR_COMMIT, robe->seq, robe->pc, robe->opcode, ptr, -1, robe->lsq_idx, cpu->rob.cfid[ptr]);
+				cpu->committed++;
+				cpu->perf.committed[insn_class(robe->opcode)]++;
+			}
+			bitmap_clear(cpu->rob.taken, ptr);
+			cpu->rob.head_ptr = (cpu->rob.head_ptr + 1) % cpu->rob.size; // update rob head_ptr		
 		
 			update_print_stack("Commit", cpu, get_code_index(robe->pc));
+			if(is_halt(robe->opcode)) break; // nothing younger retires
 		} else break; // can't commit further insn 
 	}
 
@@ -1016,30 +1656,131 @@ char no_more_insn(cpu_t* cpu) {
 	if(cpu->done) return cpu->done; // if halt occurred, this is already set
 
 	char rob_empty = 0;
-	if(cpu->rob.head_ptr == cpu->rob.tail_ptr && !cpu->rob.entries[cpu->rob.head_ptr].taken) rob_empty = 1;
+	if(cpu->rob.head_ptr == cpu->rob.tail_ptr && !bitmap_test(cpu->rob.taken, cpu->rob.head_ptr)) rob_empty = 1;
 
+	// a front-end latch or an in-flight memory access still holds a real insn ; the fetch latch only keeps a copy of what it passed to decode
 	char done = 1;
-	int ptr = cpu->print_stack_ptr - 1;
-	for(int i=ptr; i>=0; i--) {
-		print_info_t* p = &cpu->print_stack[i];
-		stage_t* stage = &cpu->print_info[p->idx];
-		if(strcmp(p->name, "Commit") == 0) continue;
-		if(is_valid_insn(stage->opcode) && strcmp(stage->opcode, "NOP")) {
-			if(strcmp(p->name, "Memory") == 0 && cpu->memFU.busy <= 0) continue;
-			done = 0;
-			break;
+	for(int i=DRF; i<=DP; i++) {
+		latch_t* latch = &cpu->stage[i];
+		for(int j=0; j<latch->count; j++) {
+			opcode_t op = latch->slots[j].opcode;
+			if(is_valid_insn(op) && !is_nop(op)) done = 0;
 		}
-	}	
+	}
+	if(mem_in_flight(cpu)) done = 0;
+
 	return (rob_empty && done);
 }
 
+// entries in use in a circular queue ; head == tail is either empty or full
+static int queue_num(int head_ptr, int tail_ptr, int size, char head_taken) {
+	if(head_ptr == tail_ptr) return head_taken ? size : 0;
+	return (tail_ptr - head_ptr + size) % size;
+}
+
+/*
+
+	Idle-cycle skipping ; a cycle in which nothing but timers moved repeats itself, stalls and all, until the next timer runs out
+
+*/
+
+// everything a cycle can change besides FU timers and counters
+typedef struct idle_state_t {
+	int events;
+	int pc;
+	int rob_head;
+	int rob_tail;
+	int lsq_head;
+	int lsq_tail;
+	int iq_num;
+	int latch_count[DP+1];
+	int latch_busy[DP+1];
+	char latch_stalled[DP+1];
+	char store_ready; // memory() picks up the source of the LSQ head on its own
+} idle_state_t;
+
+typedef struct idle_t {
+	idle_state_t state;
+	int stalls[NUM_STALLS];
+	int mshr_full;
+} idle_t;
+
+static void idle_snapshot(cpu_t* cpu, idle_t* idle) {
+	memset(idle, 0, sizeof(idle_t)); // padding too ; the state is compared with memcmp
+	idle_state_t* s = &idle->state;
+	s->events = cpu->events;
+	s->pc = cpu->pc;
+	s->rob_head = cpu->rob.head_ptr;
+	s->rob_tail = cpu->rob.tail_ptr;
+	s->lsq_head = cpu->lsq.head_ptr;
+	s->lsq_tail = cpu->lsq.tail_ptr;
+	s->iq_num = cpu->iq_num;
+	for(int i=F; i<=DP; i++) {
+		s->latch_count[i] = cpu->stage[i].count;
+		s->latch_busy[i] = cpu->stage[i].busy;
+		s->latch_stalled[i] = cpu->stage[i].stalled;
+	}
+	s->store_ready = cpu->lsq.entries[cpu->lsq.head_ptr].u_rs2_ready;
+	memcpy(idle->stalls, cpu->perf.stalls, sizeof(idle->stalls));
+	idle->mshr_full = cpu->cache.mshr_full;
+}
+
+// cycles after this one that would repeat it exactly ; every FU, memFU and MSHR timer stays on the same side of each threshold the pipeline tests
+static int idle_horizon(cpu_t* cpu) {
+	int k = INT_MAX;
+	for(int t=0; t<NUM_FU_TYPES; t++) {
+		fu_pool_t* pool = &cpu->fu[t];
+		for(int s=0; s<pool->units * pool->depth; s++) {
+			int busy = pool->slots[s].busy;
+			if(!busy) return 0; // completed this cycle
+			if(busy > 0 && busy - 1 < k) k = busy - 1; // completes busy cycles from now
+			int ii_left = busy + 1 - (pool->lat - pool->ii); // unit_slot() lets the unit take another insn then
+			if(ii_left > 0 && ii_left - 1 < k) k = ii_left - 1;
+		}
+	}
+	for(int s=0; s<cpu->mem_slots; s++) {
+		int busy = cpu->memFU[s].busy;
+		if(!busy) return 0;
+		if(busy > 0 && busy - 1 < k) k = busy - 1;
+	}
+	for(int i=0; i<cpu->cache.num_mshrs; i++) { // a LOAD or STORE turned away gets one once it frees
+		int left = cpu->cache.mshr[i].ready - cpu->clock;
+		if(left > 0 && left - 1 < k) k = left - 1;
+	}
+	if(cpu->stop_cycle > cpu->clock && cpu->stop_cycle - cpu->clock - 1 < k) k = cpu->stop_cycle - cpu->clock - 1;
+	return k == INT_MAX ? 0 : k; // nothing will ever change ; step it like before
+}
+
+// runs k more cycles like the idle one just simulated, at once
+static void idle_skip(cpu_t* cpu, const idle_t* before, int k) {
+	cpu->clock += k;
+	for(int t=0; t<NUM_FU_TYPES; t++) {
+		fu_pool_t* pool = &cpu->fu[t];
+		for(int s=0; s<pool->units * pool->depth; s++) {
+			pool->slots[s].busy -= k;
+		}
+	}
+	for(int s=0; s<cpu->mem_slots; s++) {
+		cpu->memFU[s].busy -= k;
+	}
+	for(int i=0; i<NUM_STALLS; i++) {
+		cpu->perf.stalls[i] += k * (cpu->perf.stalls[i] - before->stalls[i]);
+	}
+	cpu->cache.mshr_full += k * (cpu->cache.mshr_full - before->mshr_full);
+	perf_sample(&cpu->perf, cpu->iq_num, queue_num(cpu->rob.head_ptr, cpu->rob.tail_ptr, cpu->rob.size, bitmap_test(cpu->rob.taken, cpu->rob.head_ptr)), queue_num(cpu->lsq.head_ptr, cpu->lsq.tail_ptr, cpu->lsq.size, bitmap_test(cpu->lsq.taken, cpu->lsq.head_ptr)), k);
+}
+
 /* Main simulation loop */
 int cpu_run(cpu_t* cpu, char* command) {
 	
-	if(strcmp(command, "display") == 0) display_cycle = 1;
+	cpu->display_cycle = (strcmp(command, "display") == 0);
+	if(cpu->fault) return 0; // nothing past the bad access runs
 	
 	while(1) {
 	
+		idle_t before;
+		if(!cpu->display_cycle) idle_snapshot(cpu, &before);
+
 		cpu->clock++;				
 		cpu->print_stack_ptr = 0; // reset
 		cpu->print_memory = 0; // reset
@@ -1050,15 +1791,23 @@ int cpu_run(cpu_t* cpu, char* command) {
 		dispatch(cpu);
 		decode(cpu);
 		fetch(cpu);
+		perf_sample(&cpu->perf, cpu->iq_num, queue_num(cpu->rob.head_ptr, cpu->rob.tail_ptr, cpu->rob.size, bitmap_test(cpu->rob.taken, cpu->rob.head_ptr)), queue_num(cpu->lsq.head_ptr, cpu->lsq.tail_ptr, cpu->lsq.size, bitmap_test(cpu->lsq.taken, cpu->lsq.head_ptr)), 1);
 		
-		if(display_cycle) display(cpu);
+		if(cpu->display_cycle) display(cpu);
 				
 		cpu->done = no_more_insn(cpu);
-		if(cpu->clock == cpu->stop_cycle || cpu->done) {
-			printf("sim> Reached %i cycles\n", cpu->clock);
+		if(cpu->clock == cpu->stop_cycle || cpu->done || cpu->fault || (cpu->stop_insn && cpu->committed >= cpu->stop_insn)) {
+			if(!cpu->batch) printf("sim> Reached %i cycles\n", cpu->clock);
 			break;
 		}
 
+		// nothing moved but timers ; jump to the cycle before the next one runs out, every display shows its own cycle
+		if(cpu->display_cycle) continue;
+		idle_t after;
+		idle_snapshot(cpu, &after);
+		if(memcmp(&before.state, &after.state, sizeof(idle_state_t))) continue;
+		int k = idle_horizon(cpu);
+		if(k) idle_skip(cpu, &before, k);
 	}
 		
 	return 0;
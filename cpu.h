@@ -1,30 +1,31 @@
 #ifndef CPU_H
 #define CPU_H
 
+#include <stdint.h>
+
+#include "bitmap.h"
+#include "config.h" // queue sizes, latencies and the rest of the machine parameters
+#include "bpred.h"
+#include "perf.h"
+#include "trace.h"
+#include "cache.h"
+
 /*
 
-	CPU Configuration Values
+	CPU Configuration Values ; fixed by the ISA
 
 */
 
 #define NUM_ARCH_REGS 16
-#define NUM_UNIFIED_REGS 40
 #define CODE_START_ADDR 4000
-#define MEM_SIZE 4000
-
-#define IQ_SIZE 16 // max entries of instruction queue
-#define ROB_SIZE 32 // max entries of reorder buffer
-#define LSQ_SIZE 20 // max entries in load-store queue
 
-#define CFQ_SIZE 8
-
-#define MAX_COMMIT_NUM 2 // max number of instructions that can commit
+#define ZERO_FLAG NUM_ARCH_REGS // index into rename table that points to the u_rd of the most recent zero-flag value
 
-#define INT_FU_LAT 1
-#define MUL_FU_LAT 2
-#define MEM_FU_LAT 3
+// operands waiting on a unified register ; IQ entries have one wait node per source, LSQ entries one for the store data
+enum { WAIT_RS1, WAIT_RS2, WAIT_ZF, NUM_IQ_WAITS };
 
-#define ZERO_FLAG NUM_ARCH_REGS // index into rename table that points to the u_rd of the most recent zero-flag value
+// issue selects from one age-ordered ready queue per FU type ; with an AGU, memory addresses and branch decisions leave FU_INT
+enum { FU_INT, FU_MUL, FU_AGU, NUM_FU_TYPES };
 
 /*
 
@@ -34,20 +35,68 @@
 
 enum { F, DRF, DP, IS, EX, MEM, WB, CM, NUM_STAGES };
 
+// opcodes are decoded once by the assembler ; every stage works on the enum
+typedef enum opcode_t {
+	OP_INVALID = 0, // past the end of the code ; stalls the front-end
+	OP_NOP,
+	OP_ADD,
+	OP_SUB,
+	OP_AND,
+	OP_OR,
+	OP_XOR,
+	OP_MUL,
+	OP_MOVC,
+	OP_ADDL,
+	OP_SUBL,
+	OP_LOAD,
+	OP_STORE,
+	OP_BZ,
+	OP_BNZ,
+	OP_JUMP,
+	OP_JAL,
+	OP_HALT,
+	NUM_OPCODES
+} opcode_t;
+
+// opcode property bits ; index opcode_props[] with an opcode_t
+#define OPP_VALID	0x001 // recognized by the simulator
+#define OPP_RD		0x002 // writes rd
+#define OPP_RS1		0x004 // reads rs1
+#define OPP_RS2		0x008 // reads rs2
+#define OPP_ZF		0x010 // becomes the most recent zero-flag producer
+#define OPP_READS_ZF	0x020 // waits on the zero-flag (BZ, BNZ)
+#define OPP_CF		0x040 // control-flow
+#define OPP_MEM		0x080 // LOAD, STORE
+#define OPP_INTFU	0x100 // executes (or computes its address) on intFU ; or the AGU for memory and control-flow insn
+#define OPP_MULFU	0x200 // executes on mulFU
+
+extern const char* opcode_names[NUM_OPCODES];
+extern const unsigned short opcode_props[NUM_OPCODES];
+
 typedef struct insn_t {
-	char opcode[128];
+	opcode_t opcode;
 	int rd;
 	int rs1;
 	int rs2;
 	int imm;
 } insn_t;
 
-/* latch for initial parts of the pipeline (Fetch, Decode) */
+// an assembled program
+typedef struct program_t {
+	insn_t* code;
+	int code_size;
+	int* data; // memory from address 0 on, as .data leaves it ; the rest starts as 0
+	int data_size;
+	void* map; // program image code and data point into ; NULL if they were assembled
+	size_t map_size;
+} program_t;
+
+/* one insn slot of a front-end latch (Fetch, Decode, Dispatch) */
 typedef struct stage_t { 
 	char name[128]; // for printing
 
 	int pc;
-	char opcode[128];
+	opcode_t opcode;
 
 	// architectural register addresses	
 	int rd; // destination register address
@@ -58,10 +107,16 @@ typedef struct stage_t {
 	int u_rd;
 	int u_rs1;
 	int u_rs2;
+	int zero_flag_u_rd; // BZ and BNZ ; most recent zero-flag producer when this insn was renamed
+
+	// control-flow insn ; rename table right after this insn was renamed, restored if it is taken
+	int rename_table[NUM_ARCH_REGS + 1];
+	int free_head; // control-flow insn ; free-list head right after this insn was renamed
+	bpred_info_t pred; // control-flow insn ; what fetch predicted
+	int seq; // trace id, in fetch order
 
 	//status 	
 	int busy;
-	int stalled;
 
 	// just for printing
 	int print_idx;
@@ -72,6 +127,14 @@ typedef struct stage_t {
 	
 } stage_t;
 
+// latch between two front-end stages ; holds a group of up to width insn, oldest first
+typedef struct latch_t {
+	stage_t* slots; // width entries
+	int count; // insn in the group
+	int busy; // blocked for this many cycles
+	char stalled; // blocked until the next group arrives
+} latch_t;
+
 // functional unit
 typedef struct fu_t {	
 
@@ -79,7 +142,7 @@ typedef struct fu_t {
 	
 	int rob_idx;
 
-	char opcode[128];
+	opcode_t opcode;
 	int u_rd;
 	int u_rd_val;
 	int imm; // literal
@@ -90,6 +153,8 @@ typedef struct fu_t {
 	// only used by memFU
 	int mem_addr;
 	int rd; // so LOADs can free physical registers
+	int lsq_idx;
+	char forwarded; // a LOAD whose value is in u_rs2_val, taken from an older STORE
 
 	// BZ and BNZ
 	int pc;
@@ -97,11 +162,21 @@ typedef struct fu_t {
 
 	// control insn id
 	int cfid;
+	int seq; // trace id
 
 	int busy;
 
 } fu_t;
 
+// identical FUs ; a unit takes a new insn every ii cycles, so it has up to depth of them in flight
+typedef struct fu_pool_t {
+	int units;
+	int lat;
+	int ii; // initiation interval
+	int depth; // ceil(lat / ii)
+	fu_t* slots; // units * depth ; slot s belongs to unit s % units
+} fu_pool_t;
+
 // architectural register
 typedef struct areg_t {
 	char valid;
@@ -117,10 +192,9 @@ typedef struct ureg_t {
 	int val; // data value
 } ureg_t;
 
-// reorder buffer
+// reorder buffer ; the taken flag and cfid of each entry live in rob_t, apart from the rest
 typedef struct rob_entry_t {
-	char taken;
-	char opcode[128];
+	opcode_t opcode;
 	int pc; // program counter
 	
 	// architectural register addresses	
@@ -132,24 +206,26 @@ typedef struct rob_entry_t {
 	char zero_flag;
 
 	int lsq_idx; // load-store queue index ; only needed for memory operations
-	int cfid; // control flow insn id
+	int seq; // trace id
 
 } rob_entry_t;
 
 typedef struct rob_t {	
 	int head_ptr;
 	int tail_ptr;
-	rob_entry_t entries[ROB_SIZE];
+	int size;
+	rob_entry_t* entries;
+	uint64_t* taken; // bit i set while entry i is in use
+	int* cfid; // control flow insn id of each entry ; packed so a cfid scan reads nothing else
+	uint64_t* brmask; // branch masks by branch ; cfq_size rows of bitmap_words(size), bit i of row b set while entry i is on the path of unresolved branch b
 } rob_t;
 
-// instruction queue
+// instruction queue ; whether an entry is free and its cfid are kept in cpu_t, apart from the rest
 typedef struct iq_entry_t {
-	char taken;
-
 	int pc; // just for printing
 
-	int cycle_dispatched; // earliest insn is issued first
-	char opcode[128];
+	int cycle_dispatched; // just for printing
+	opcode_t opcode;
 	int imm; // literal operand
 
 	int u_rs1; // unified register address ; used for tag matching
@@ -166,19 +242,16 @@ typedef struct iq_entry_t {
 
 	int rob_idx; // where to send computed value
 	int lsq_idx; // where to send computed memory address ; only needed for memory operations
-	int cfid; // control flow id
 
 } iq_entry_t;
 
-// load-store queue
+// load-store queue ; the taken flag and cfid of each entry live in lsq_t, apart from the rest
 typedef struct lsq_entry_y {
-	char taken;	
 	char done; // memory operation done, did not commit
 	int rob_idx;
 	int pc; 
-	int cfid; // control-flow id
 
-	char opcode[128]; // load or store
+	opcode_t opcode; // load or store
 	char mem_addr_valid;
 	int mem_addr;
 	
@@ -189,18 +262,36 @@ typedef struct lsq_entry_y {
 	char u_rs2_ready; // data to be stored ; for store only
 	int u_rs2; // register address that holds value to be stored
 	int u_rs2_val; // value to be stored	
+
+	// LOADs that run ahead of the ROB head (load_issue other than inorder)
+	char issued; // sent to memFU
+	int fwd_idx; // STORE whose data it took ; -1 if it read memory
+	char violated; // an older STORE to the same address resolved after it ; replayed when it reaches commit
 } lsq_entry_t;
 
 typedef struct lsq_t {
 	int head_ptr;
 	int tail_ptr;
-	lsq_entry_t entries[LSQ_SIZE];
+	int size;
+	lsq_entry_t* entries;
+	uint64_t* taken; // bit i set while entry i is in use
+	int* cfid; // control-flow id of each entry
+	uint64_t* brmask; // branch masks, as in rob_t
 } lsq_t;
 
+// node in a unified register's list of waiting operands
+typedef struct wait_node_t {
+	int reg; // unified register this node waits on ; -1 if not linked
+	int prev;
+	int next;
+} wait_node_t;
+
 // for control-flow insn
+// rename checkpoint of an in-flight control-flow insn ; register values stay in the URF, which a recovery leaves alone
 typedef struct saved_state_t {
-	ureg_t unified_regs[NUM_UNIFIED_REGS];
-	int front_rename_table[NUM_ARCH_REGS];	
+	int front_rename_table[NUM_ARCH_REGS + 1]; // +1 for zero-flag
+	int free_head; // every register handed out after this point goes back on the free list
+	bpred_info_t pred; // checked when the insn resolves
 } saved_state_t;
 
 typedef struct print_info_t {
@@ -209,44 +300,79 @@ typedef struct print_info_t {
 } print_info_t;
 
 typedef struct cpu_t {
+	config_t config;
+
 	int clock;
 	int stop_cycle; // when to stop the simulation
+	int stop_insn; // or once this many insn committed ; 0 for no limit
 	char done; // if no more valid instructions are coming out of Fetch, stop
+	char fault; // a LOAD or STORE outside memory reached the ROB head ; the run stops there and does not go on
+	char batch; // headless run ; no printing and no print_info/print_stack bookkeeping
+	char display_cycle; // prints state of each cycle
+	int committed; // number of retired insn ; flushed insn are not counted
+	int fast_forwarded; // insn executed by cpu_fast_forward() before the pipeline started ; not in committed
+	int events; // insn lifecycle events so far, traced or not ; a cycle without one only moved timers
 	
 	int pc;		
-	insn_t* code;
+	insn_t* code; // points into a program image mapping or the assembled program ; never written
 	int code_size;	
-	int memory[4096];	
+	program_t program; // the program code belongs to when the cpu loaded or copied it ; zeroed when the caller keeps it
+	int* memory; // mem_size words ; points into ckpt_map after a restore
+	void* ckpt_map; // checkpoint file mapped by cpu_restore() ; NULL otherwise
+	size_t ckpt_size;
 
 	areg_t arch_regs[NUM_ARCH_REGS];	
-	ureg_t unified_regs[NUM_UNIFIED_REGS];
-	stage_t stage[NUM_STAGES];
+	ureg_t* unified_regs; // num_unified_regs entries
+	int* free_regs; // circular free list of unified registers ; allocated from the head, released at the tail
+	int free_head; // free_head and free_tail count modulo 2 * num_unified_regs, so a full list differs from an empty one
+	int free_tail;
+	latch_t stage[NUM_STAGES]; // only the front-end (F, DRF, DP) has latches
 
 	int front_rename_table[NUM_ARCH_REGS + 1]; // arch reg -> unified reg mapping ; +1 for zero-flag
 	int back_rename_table[NUM_ARCH_REGS + 1]; // arch reg -> commited values in unified reg file ; +1 for zero flag
 
 	rob_t rob;
-	iq_entry_t iq[IQ_SIZE];
+	iq_entry_t* iq; // iq_size entries
+	int iq_num; // entries in use
+	uint64_t* iq_free; // bit i set while IQ entry i is free
+	int* iq_cfid; // control flow id of each IQ entry
+	uint64_t* iq_brmask; // branch masks, as in rob_t
 	lsq_t lsq;
+	uint64_t* tag_mask; // tag_match() results ; one bit per entry of the largest queue
+
+	/* wakeup and select */
+	int* wait_head; // consumers of each unified register
+	wait_node_t* wait_nodes; // index with iq_idx * NUM_IQ_WAITS + WAIT_*, or iq_size * NUM_IQ_WAITS + lsq_idx
+	uint64_t* iq_ready; // ready sets of the IQ, one bitmap per FU type
+	uint64_t* iq_age; // age matrix ; iq_size rows of bitmap_words(iq_size), bit j of row i set if entry j is older than entry i
 
 	/* functional units */
-	fu_t intFU;
-	fu_t mulFU;
-	fu_t memFU; 
+	fu_pool_t fu[NUM_FU_TYPES]; // intFU, mulFU and the AGU, by FU type
+	fu_t* memFU; // mem_slots accesses in flight ; slot s belongs to port s % mem_ports
+	int mem_ports; // load_ports + store_ports
+	int mem_slots; // mem_ports * the accesses one port can have in flight
 
 	/* control flow handling (BZ, BNZ, JUMP) */
 	int cfid; // the current cfid ; change with every control-flow insn
-	char cfid_freelist[CFQ_SIZE]; // list of free ids ; index = id, value = free/taken
-	int cfq[CFQ_SIZE];
+	uint64_t* cfid_free; // bit id set while the id is free
+	uint64_t* unresolved; // bit id set while its branch has not executed ; insn dispatched now go on its path
+	int* cfq; // cfids in flight, oldest at cfq_head_ptr ; a cfid is released when its insn commits or is flushed
 	int cfq_head_ptr;
 	int cfq_tail_ptr;
-	saved_state_t saved_state[CFQ_SIZE]; // index by using cfid
+	int cfq_num;
+	saved_state_t* saved_state; // index by using cfid
+	bpred_t bpred; // fetch follows its predictions ; a wrong one is flushed like a taken branch used to be
+	cache_t cache; // timing of memFU accesses ; off unless l1d_size is set
+
+	perf_t perf; // counters for the whole run
+	trace_t* trace; // NULL unless tracing ; opened and closed by the caller
+	int fetch_seq; // next trace id
 
 	// holds all instruction information ; to index into this, use get_code_index(pc)
 	stage_t* print_info;
 
 	// info about current cycle only	
-	print_info_t print_stack[16]; // holds indicies into print_info[]
+	print_info_t* print_stack; // holds indicies into print_info[] ; one entry per slot and FU
 	int print_stack_ptr;
 	
 	char print_memory; // no need to pring memory all the time ; only when mem access occurs and at the last displayed cycle
@@ -259,10 +385,23 @@ typedef struct cpu_t {
 
 */
 
-insn_t* create_code(const char* filename, int* size);
-cpu_t* cpu_init(const char* filename);
+int program_load(const char* filename, program_t* prog); // assembly text or a program image ; 0 on success, errors go to stderr with their line
+int program_assemble(const char* text, size_t len, const char* name, program_t* prog); // the same from text already in memory, a mapped file for one
+void program_free(program_t* prog);
+opcode_t decode_opcode(const char* str);
+cpu_t* cpu_init(const char* filename, const config_t* config, char batch);
+cpu_t* cpu_init_code(const insn_t* code, int code_size, const config_t* config, char batch);
+cpu_t* cpu_init_program(const program_t* prog, const config_t* config, char batch); // code and the .data memory image
 int cpu_run(cpu_t* cpu, char* command);
+int cpu_fast_forward(cpu_t* cpu, int max_insn, int stop_pc); // before cpu_run() ; executes up to max_insn insn (<= 0 for no limit) or until pc == stop_pc without timing ; insn executed, -1 on failure
 void cpu_stop(cpu_t* cpu);
+void ureg_rebuild_free_list(cpu_t* cpu); // every register not taken goes back on the free list, lowest first
+
+/* Opcode and pc helpers */
+int get_code_index(int pc);
+char is_valid_insn(opcode_t opcode);
+char is_mem(opcode_t opcode);
+char is_controlflow(opcode_t opcode);
 
 /* Pipeline stages */
 int fetch(cpu_t* cpu);
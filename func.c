@@ -0,0 +1,191 @@
+/* Functional simulation ; runs insn architecturally, then hands the state to the pipeline */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpu.h"
+#include "simpoint.h"
+
+// architectural state while fast-forwarding ; registers never written read as 0, like an unmapped source in dispatch
+typedef struct func_state_t {
+	int regs[NUM_ARCH_REGS];
+	char written[NUM_ARCH_REGS];
+	char zero_flag;
+	int zf_reg; // arch reg whose last write also set the zero-flag ; -1 if none or since overwritten
+	char zf_set; // any zero-flag producer ran
+} func_state_t;
+
+static void write_reg(func_state_t* s, int rd, int val, char sets_zf, char zf) {
+	s->regs[rd] = val;
+	s->written[rd] = 1;
+	if(sets_zf) {
+		s->zero_flag = zf;
+		s->zf_reg = rd;
+		s->zf_set = 1;
+	} else if(s->zf_reg == rd) s->zf_reg = -1; // the flag outlives the value it came with
+}
+
+// maps every written arch reg to its own unified register, as if each had just committed ; -1 if the URF is too small
+static int handoff(cpu_t* cpu, func_state_t* s) {
+	int u = 0;
+	for(int r=0; r<NUM_ARCH_REGS; r++) {
+		if(!s->written[r]) continue;
+		if(u == cpu->config.num_unified_regs) return -1;
+		ureg_t* ureg = &cpu->unified_regs[u];
+		ureg->taken = 1;
+		ureg->valid = 1;
+		ureg->val = s->regs[r];
+		ureg->zero_flag = 0;
+		cpu->arch_regs[r].u_rd = u;
+		cpu->front_rename_table[r] = u;
+		cpu->back_rename_table[r] = u;
+		u++;
+	}
+
+	if(!s->zf_set) return 0;
+	int zf_u = s->zf_reg != -1 ? cpu->front_rename_table[s->zf_reg] : -1;
+	if(zf_u == -1) { // the producer's value was overwritten ; the flag keeps a register of its own
+		if(u == cpu->config.num_unified_regs) return -1;
+		zf_u = u;
+		cpu->unified_regs[zf_u].taken = 1;
+		cpu->unified_regs[zf_u].valid = 1;
+	}
+	cpu->unified_regs[zf_u].zero_flag = s->zero_flag;
+	cpu->front_rename_table[ZERO_FLAG] = zf_u;
+	cpu->back_rename_table[ZERO_FLAG] = zf_u;
+	return 0;
+}
+
+// executes the insn at *pc ; 1 if it counts as committed, 0 for a NOP, -1 if the pipeline has to take over here
+static int step(cpu_t* cpu, func_state_t* s, int* pc) {
+	int code_idx = get_code_index(*pc);
+	if(code_idx < 0 || code_idx >= cpu->code_size) return -1; // the pipeline stalls on it
+	const insn_t* insn = &cpu->code[code_idx];
+	if(!is_valid_insn(insn->opcode)) return -1;
+
+	int rs1 = insn->rs1 == -1 ? 0 : s->regs[insn->rs1]; // -1 for an operand the opcode does not have
+	int rs2 = insn->rs2 == -1 ? 0 : s->regs[insn->rs2];
+	int addr = rs1 + insn->imm; // LOAD and STORE
+	if(is_mem(insn->opcode) && (addr < 0 || addr >= cpu->config.mem_size)) return -1; // leave the bad access to the pipeline
+	int next_pc = *pc + 4;
+	int val;
+	switch(insn->opcode) {
+		case OP_NOP: *pc = next_pc; return 0; // never committed
+		case OP_ADD: val = rs1 + rs2; write_reg(s, insn->rd, val, 1, val == 0); break;
+		case OP_SUB: val = rs1 - rs2; write_reg(s, insn->rd, val, 1, val == 0); break;
+		case OP_AND: val = rs1 & rs2; write_reg(s, insn->rd, val, 1, val == 0); break;
+		case OP_OR: val = rs1 | rs2; write_reg(s, insn->rd, val, 1, val == 0); break;
+		case OP_XOR: val = rs1 ^ rs2; write_reg(s, insn->rd, val, 1, val == 0); break;
+		case OP_MUL: val = rs1 * rs2; write_reg(s, insn->rd, val, 1, val == 0); break;
+		case OP_ADDL: val = rs1 + insn->imm; write_reg(s, insn->rd, val, 1, val == 0); break;
+		case OP_SUBL: val = rs1 - insn->imm; write_reg(s, insn->rd, val, 1, val == 0); break;
+		case OP_MOVC: write_reg(s, insn->rd, insn->imm, 0, 0); break;
+		case OP_LOAD: write_reg(s, insn->rd, cpu->memory[addr], 0, 0); break;
+		case OP_STORE: cpu->memory[addr] = rs2; break;
+		case OP_BZ: if(s->zero_flag) next_pc = *pc + insn->imm; break;
+		case OP_BNZ: if(!s->zero_flag) next_pc = *pc + insn->imm; break;
+		case OP_JUMP: next_pc = rs1 + insn->imm; break;
+		case OP_JAL: write_reg(s, insn->rd, *pc + 4, 1, 0); next_pc = rs1 + insn->imm; break; // claims the zero-flag but leaves it cleared
+		case OP_HALT: cpu->done = 1; break;
+		default: break;
+	}
+	*pc = next_pc;
+	return 1;
+}
+
+int cpu_fast_forward(cpu_t* cpu, int max_insn, int stop_pc) {
+	func_state_t s;
+	memset(&s, 0, sizeof(s));
+	s.zf_reg = -1;
+
+	int n = 0;
+	int pc = cpu->pc;
+	while(max_insn <= 0 || n < max_insn) {
+		if(pc == stop_pc) break;
+		int ret = step(cpu, &s, &pc);
+		if(ret < 0) break;
+		n += ret;
+		if(cpu->done) break;
+	}
+
+	if(handoff(cpu, &s)) {
+		fprintf(stderr, "sim> Not enough unified registers to hold the fast-forwarded state\n");
+		return -1;
+	}
+	ureg_rebuild_free_list(cpu);
+	cpu->pc = pc;
+	cpu->fast_forwarded = n;
+	return n;
+}
+
+void bbv_free(bbv_t* bbv) {
+	free(bbv->counts);
+	free(bbv->lengths);
+	memset(bbv, 0, sizeof(bbv_t));
+}
+
+// one more interval row, zeroed ; -1 if out of memory
+static int bbv_grow(bbv_t* bbv, int* capacity) {
+	if(bbv->num_intervals == *capacity) {
+		int cap = *capacity ? 2 * *capacity : 64;
+		int* counts = realloc(bbv->counts, (size_t) cap * bbv->code_size * sizeof(int));
+		if(!counts) return -1;
+		bbv->counts = counts;
+		int* lengths = realloc(bbv->lengths, cap * sizeof(int));
+		if(!lengths) return -1;
+		bbv->lengths = lengths;
+		*capacity = cap;
+	}
+	memset(&bbv->counts[(size_t) bbv->num_intervals * bbv->code_size], 0, bbv->code_size * sizeof(int));
+	bbv->lengths[bbv->num_intervals++] = 0;
+	return 0;
+}
+
+int cpu_profile(cpu_t* cpu, int interval, int max_insn, bbv_t* bbv) {
+	memset(bbv, 0, sizeof(bbv_t));
+	if(interval <= 0) return -1;
+	bbv->interval = interval;
+	bbv->code_size = cpu->code_size;
+
+	// taken targets of BZ and BNZ start a block ; so does whatever follows any control-flow insn
+	char* leader = calloc(cpu->code_size, sizeof(char));
+	if(!leader) return -1;
+	for(int i=0; i<cpu->code_size; i++) {
+		const insn_t* insn = &cpu->code[i];
+		int target = get_code_index(CODE_START_ADDR + 4 * i + insn->imm);
+		if((insn->opcode == OP_BZ || insn->opcode == OP_BNZ) && target >= 0 && target < cpu->code_size) leader[target] = 1;
+	}
+
+	func_state_t s;
+	memset(&s, 0, sizeof(s));
+	s.zf_reg = -1;
+
+	int capacity = 0;
+	int block = -1;
+	int n = 0;
+	int pc = cpu->pc;
+	while(max_insn <= 0 || n < max_insn) {
+		int code_idx = get_code_index(pc);
+		if(code_idx >= 0 && code_idx < cpu->code_size && (block == -1 || leader[code_idx])) block = code_idx;
+		int ret = step(cpu, &s, &pc);
+		if(ret < 0) break;
+		if(!ret) continue;
+
+		if(n % interval == 0 && bbv_grow(bbv, &capacity)) {
+			free(leader);
+			bbv_free(bbv);
+			return -1;
+		}
+		bbv->counts[(size_t) (bbv->num_intervals - 1) * bbv->code_size + block]++;
+		bbv->lengths[bbv->num_intervals - 1]++;
+		n++;
+		if(is_controlflow(cpu->code[code_idx].opcode)) block = -1;
+		if(cpu->done) break;
+	}
+	free(leader);
+
+	bbv->total_insn = n;
+	bbv->completed = cpu->done;
+	return 0;
+}
@@ -0,0 +1,84 @@
+/* Program images ; written by ./assemble, mapped by program_load() */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "image.h"
+
+static uint64_t fnv1a(uint64_t h, const void* data, size_t size) {
+	const unsigned char* p = data;
+	for(size_t i=0; i<size; i++) {
+		h = (h ^ p[i]) * 1099511628211ull;
+	}
+	return h;
+}
+
+uint64_t image_checksum(const program_t* prog) {
+	uint64_t h = 14695981039346656037ull;
+	h = fnv1a(h, prog->code, prog->code_size * sizeof(insn_t));
+	return fnv1a(h, prog->data, prog->data_size * sizeof(int));
+}
+
+int image_save(const program_t* prog, const char* filename) {
+	image_header_t header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, IMAGE_MAGIC, 4);
+	header.version = IMAGE_VERSION;
+	header.insn_size = sizeof(insn_t);
+	header.code_size = prog->code_size;
+	header.data_size = prog->data_size;
+	header.checksum = image_checksum(prog);
+
+	FILE* file = fopen(filename, "wb");
+	if(!file) return -1;
+	int failed = fwrite(&header, sizeof(header), 1, file) != 1;
+	failed |= fwrite(prog->code, sizeof(insn_t), prog->code_size, file) != (size_t) prog->code_size;
+	if(prog->data_size) failed |= fwrite(prog->data, sizeof(int), prog->data_size, file) != (size_t) prog->data_size;
+	if(fclose(file)) failed = 1;
+	return failed ? -1 : 0;
+}
+
+// everything a stage indexes with ; a bad image must not send the pipeline out of its arrays
+static char valid_insn(const insn_t* insn) {
+	return insn->opcode > OP_INVALID && insn->opcode < NUM_OPCODES
+		&& insn->rd >= -1 && insn->rd < NUM_ARCH_REGS // -1 if the opcode has no such operand
+		&& insn->rs1 >= -1 && insn->rs1 < NUM_ARCH_REGS
+		&& insn->rs2 >= -1 && insn->rs2 < NUM_ARCH_REGS;
+}
+
+int image_open(void* map, size_t size, const char* name, program_t* prog) {
+	memset(prog, 0, sizeof(program_t));
+	image_header_t header;
+	if(size < sizeof(header)) {
+		munmap(map, size);
+		return -1;
+	}
+	memcpy(&header, map, sizeof(header));
+	if(memcmp(header.magic, IMAGE_MAGIC, 4) || header.version != IMAGE_VERSION || header.insn_size != sizeof(insn_t) || header.code_size <= 0 || header.data_size < 0
+		|| sizeof(header) + (uint64_t) header.code_size * sizeof(insn_t) + (uint64_t) header.data_size * sizeof(int) != size) {
+		fprintf(stderr, "asm> %s is not a version %d program image of this simulator\n", name, IMAGE_VERSION);
+		munmap(map, size);
+		return -1;
+	}
+
+	prog->code = (insn_t*) ((char*) map + sizeof(header));
+	prog->code_size = header.code_size;
+	prog->data = header.data_size ? (int*) (prog->code + header.code_size) : NULL;
+	prog->data_size = header.data_size;
+	prog->map = map;
+	prog->map_size = size;
+	if(image_checksum(prog) != header.checksum) {
+		fprintf(stderr, "asm> %s: checksum mismatch\n", name);
+		program_free(prog);
+		return -1;
+	}
+	for(int i=0; i<prog->code_size; i++) {
+		if(!valid_insn(&prog->code[i])) {
+			fprintf(stderr, "asm> %s: bad insn %d\n", name, i);
+			program_free(prog);
+			return -1;
+		}
+	}
+	return 0;
+}
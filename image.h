@@ -0,0 +1,39 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stdint.h>
+
+#include "cpu.h"
+
+/*
+
+	Program images ; an assembled program saved as the decoded insn and its .data words, loaded without parsing
+
+	file layout:
+		image_header_t
+		code ; code_size insn_t, as the assembler left them
+		data ; data_size words, memory from address 0 on
+
+	the raw insn_t ties an image to the simulator build that wrote it ; insn_size and IMAGE_VERSION catch a mismatch
+	checksum is FNV-1a over code and data ; checked on every load, and printed by ./assemble --info to tell inputs apart
+
+*/
+
+#define IMAGE_MAGIC "APXI"
+#define IMAGE_VERSION 1
+
+typedef struct image_header_t {
+	char magic[4];
+	uint32_t version;
+	uint32_t insn_size; // sizeof(insn_t) of the writer
+	int32_t code_size;
+	int32_t data_size;
+	uint32_t reserved;
+	uint64_t checksum;
+} image_header_t;
+
+int image_save(const program_t* prog, const char* filename); // 0 on success
+int image_open(void* map, size_t size, const char* name, program_t* prog); // an image already mapped ; prog points into it and unmaps it when freed, or the map is released on failure
+uint64_t image_checksum(const program_t* prog);
+
+#endif // IMAGE_H
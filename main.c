@@ -3,23 +3,148 @@
 #include <string.h> //strtok()
 
 #include "cpu.h"
+#include "config.h"
 #include "print.h" // all printing functions
+#include "ckpt.h"
+
+// everything on the command line besides the machine parameters
+typedef struct options_t {
+	char batch;
+	char perf;
+	int max_cycles;
+	const char* output;
+	const char* trace;
+	int ff_insn; // fast-forward this many insn ; 0 for none
+	int ff_pc; // or until this pc ; -1 for none
+	const char* checkpoint; // saved when the batch run stops
+	const char* restore; // continue this checkpoint instead of starting a program
+} options_t;
 
 void print_usage() {
 	printf("sim> ./sim <simulate/display> <number of cycles>\n");
+	printf("sim> ./sim perf ; performance counters so far\n");
+	printf("sim> ./sim checkpoint <file> ; save the state to continue it with --restore\n");
 }
 
-int main(int argc, char* argv[]) {
-	if(argc != 2) {
-		printf("./sim <file.asm>\n");
-		exit(1);
+void print_args() {
+	printf("./sim [options] <file.asm>\n");
+	printf("./sim --batch [--max-cycles N] [--output file.json] [--perf] [options] <file.asm>\n");
+	printf("./sim [--batch ...] --restore <file.ckpt>\n");
+	printf("options:\n");
+	printf("  --config <file>   machine parameters, one \"key = value\" per line\n");
+	printf("  --perf            add the performance counters to the batch record\n");
+	printf("  --trace <file>    binary pipeline trace ; convert it with traceview\n");
+	printf("  --fast-forward N  execute the first N insn functionally, then simulate in detail\n");
+	printf("  --fast-forward-pc <pc>  same, up to the first time pc is reached\n");
+	printf("  --checkpoint <file>  save the whole state when the batch run stops\n");
+	printf("  --restore <file>  continue a checkpoint ; its machine parameters replace these\n");
+	printf("  --<key> <value>   set one machine parameter (defaults below)\n");
+	config_t config;
+	config_default(&config);
+	config_print(&config);
+}
+
+// cpu ready for the detailed simulation ; trace opened and fast-forward done, or restored
+cpu_t* start_cpu(const char* filename, const config_t* config, const options_t* opts) {
+	if(opts->restore) {
+		cpu_t* cpu = cpu_restore(opts->restore, opts->batch);
+		if(!cpu) fprintf(stderr, "sim> %s is not a version %d checkpoint of this simulator\n", opts->restore, CKPT_VERSION);
+		else if(opts->trace && !(cpu->trace = trace_open(opts->trace))) {
+			fprintf(stderr, "sim> Could not open %s\n", opts->trace);
+			cpu_stop(cpu);
+			return NULL;
+		}
+		return cpu;
 	}
-	
-	cpu_t* cpu = cpu_init(argv[1]);
+
+	cpu_t* cpu = cpu_init(filename, config, opts->batch);
 	if(!cpu) {
 		fprintf(stderr, "sim> Failed to initialize CPU\n");
+		return NULL;
+	}
+	if((opts->ff_insn > 0 || opts->ff_pc != -1) && cpu_fast_forward(cpu, opts->ff_insn, opts->ff_pc) < 0) {
+		cpu_stop(cpu);
+		return NULL;
+	}
+	if(opts->trace && !(cpu->trace = trace_open(opts->trace))) {
+		fprintf(stderr, "sim> Could not open %s\n", opts->trace);
+		cpu_stop(cpu);
+		return NULL;
+	}
+	return cpu;
+}
+
+// runs the whole program without printing ; writes one JSON record at the end
+int run_batch(const char* filename, const config_t* config, const options_t* opts) {
+	cpu_t* cpu = start_cpu(filename, config, opts);
+	if(!cpu) return 1;
+
+	cpu->stop_cycle = opts->max_cycles ? cpu->clock + opts->max_cycles : 0; // 0 runs until the program completes
+	if(!cpu->done) cpu_run(cpu, "simulate"); // fast-forward may have reached the HALT
+	if(cpu->trace && trace_close(cpu->trace)) fprintf(stderr, "sim> Failed to write %s\n", opts->trace);
+	cpu->trace = NULL;
+	if(opts->checkpoint && cpu_save(cpu, opts->checkpoint)) fprintf(stderr, "sim> Failed to write %s\n", opts->checkpoint);
+
+	FILE* out = stdout;
+	if(opts->output) {
+		out = fopen(opts->output, "w");
+		if(!out) {
+			fprintf(stderr, "sim> Could not open %s\n", opts->output);
+			cpu_stop(cpu);
+			return 1;
+		}
+	}
+	print_summary(cpu, filename ? filename : opts->restore, opts->perf, out);
+	if(out != stdout) fclose(out);
+
+	cpu_stop(cpu);
+	return 0;
+}
+
+int main(int argc, char* argv[]) {
+	options_t opts = { 0 };
+	opts.ff_pc = -1;
+	const char* filename = NULL;
+	config_t config;
+	config_default(&config);
+	char config_given = 0;
+
+	for(int i=1; i<argc; i++) {
+		if(strcmp(argv[i], "--batch") == 0) opts.batch = 1;
+		else if(strcmp(argv[i], "--perf") == 0) opts.perf = 1;
+		else if(strcmp(argv[i], "--max-cycles") == 0 && i+1 < argc) opts.max_cycles = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--output") == 0 && i+1 < argc) opts.output = argv[++i];
+		else if(strcmp(argv[i], "--trace") == 0 && i+1 < argc) opts.trace = argv[++i];
+		else if(strcmp(argv[i], "--fast-forward") == 0 && i+1 < argc) opts.ff_insn = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--fast-forward-pc") == 0 && i+1 < argc) opts.ff_pc = (int) strtol(argv[++i], NULL, 0);
+		else if(strcmp(argv[i], "--checkpoint") == 0 && i+1 < argc) opts.checkpoint = argv[++i];
+		else if(strcmp(argv[i], "--restore") == 0 && i+1 < argc) opts.restore = argv[++i];
+		else if(strcmp(argv[i], "--config") == 0 && i+1 < argc) {
+			if(config_load(&config, argv[++i])) exit(1);
+			config_given = 1;
+		}
+		else if(strncmp(argv[i], "--", 2) == 0 && i+1 < argc && config_set(&config, argv[i] + 2, argv[i+1]) == 0) {
+			i++;
+			config_given = 1;
+		}
+		else if(argv[i][0] != '-' && !filename) filename = argv[i];
+		else {
+			print_args();
+			exit(1);
+		}
+	}
+	if(!filename == !opts.restore || (opts.restore && (opts.ff_insn > 0 || opts.ff_pc != -1))) { // a program or a checkpoint ; fast-forward only from the start
+		print_args();
 		exit(1);
 	}
+	if(opts.restore && config_given) fprintf(stderr, "sim> Machine parameters come from %s ; ignoring the others\n", opts.restore);
+
+	if(opts.batch) return run_batch(filename, &config, &opts);
+	
+	cpu_t* cpu = start_cpu(filename, &config, &opts);
+	if(!cpu) exit(1);
+	if(opts.restore) printf("sim> Restored %s at %d cycles\n", opts.restore, cpu->clock);
+	else if(cpu->fast_forwarded) printf("sim> Fast-forwarded %d insn to pc %d\n", cpu->fast_forwarded, cpu->pc);
 	
 	//cpu_run(cpu);
 	//cpu_stop(cpu);
@@ -69,7 +194,22 @@ int main(int argc, char* argv[]) {
 			cpu_run(cpu, "display");
 			if(cpu->done) printf("sim> No more instructions to simulate. Completed at %i cycles.\n", cpu->clock);	
 
+		} else if(strcmp(token, "perf") == 0) {
+			perf_print(&cpu->perf, stdout);
+			if(cpu->cache.levels) cache_print(&cpu->cache, stdout);
+
+		} else if(strcmp(token, "checkpoint") == 0) {
+			token = strtok(NULL, " ");
+			if(!token || !token[0]) {
+				fprintf(stderr, "sim> Did not provide a file name.\n");
+				continue;
+			}
+			token[strcspn(token, "\r\n")] = 0;
+			if(cpu_save(cpu, token)) fprintf(stderr, "sim> Failed to write %s\n", token);
+			else printf("sim> Saved %s at %d cycles\n", token, cpu->clock);
+
 		} else if(strcmp(token, "quit") == 0 || strcmp(token, "q") == 0 ) {
+			if(cpu->trace && trace_close(cpu->trace)) fprintf(stderr, "sim> Failed to write %s\n", opts.trace);
  			printf("sim> Aufwiedersehen!\n");
 			break;
 		} else if(!token[0] || strcmp(token, "step") == 0) { // enter key was pressed
@@ -1,110 +1,515 @@
+/* Assembler ; one pass over the text, forward label references are patched at the end */
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
+#include <strings.h> // strncasecmp()
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "cpu.h"
+#include "image.h"
+
+/*
+
+	ADD,R1,R2,R3          operands are separated by commas, blanks or both
+	loop: SUBL R0,R0,#1   a label names the next insn, or the next data word after .data
+	BNZ,#loop             a label as a literal ; BZ and BNZ get the offset from the branch, every other insn the address
+	.data #100            the words on the following lines go to memory from address 100 on, until .text
+	#1, #2, loop          data words ; literals with or without the #
+	; comment             and // to the end of the line
+
+*/
+
+const char* opcode_names[NUM_OPCODES] = {
+	[OP_INVALID] = "",
+	[OP_NOP] = "NOP",
+	[OP_ADD] = "ADD",
+	[OP_SUB] = "SUB",
+	[OP_AND] = "AND",
+	[OP_OR] = "OR",
+	[OP_XOR] = "XOR",
+	[OP_MUL] = "MUL",
+	[OP_MOVC] = "MOVC",
+	[OP_ADDL] = "ADDL",
+	[OP_SUBL] = "SUBL",
+	[OP_LOAD] = "LOAD",
+	[OP_STORE] = "STORE",
+	[OP_BZ] = "BZ",
+	[OP_BNZ] = "BNZ",
+	[OP_JUMP] = "JUMP",
+	[OP_JAL] = "JAL",
+	[OP_HALT] = "HALT",
+};
+
+const unsigned short opcode_props[NUM_OPCODES] = {
+	[OP_INVALID] = 0,
+	[OP_NOP] = OPP_VALID,
+	[OP_ADD] = OPP_VALID | OPP_RD | OPP_RS1 | OPP_RS2 | OPP_ZF | OPP_INTFU,
+	[OP_SUB] = OPP_VALID | OPP_RD | OPP_RS1 | OPP_RS2 | OPP_ZF | OPP_INTFU,
+	[OP_AND] = OPP_VALID | OPP_RD | OPP_RS1 | OPP_RS2 | OPP_ZF | OPP_INTFU,
+	[OP_OR] = OPP_VALID | OPP_RD | OPP_RS1 | OPP_RS2 | OPP_ZF | OPP_INTFU,
+	[OP_XOR] = OPP_VALID | OPP_RD | OPP_RS1 | OPP_RS2 | OPP_ZF | OPP_INTFU,
+	[OP_MUL] = OPP_VALID | OPP_RD | OPP_RS1 | OPP_RS2 | OPP_ZF | OPP_MULFU,
+	[OP_MOVC] = OPP_VALID | OPP_RD | OPP_INTFU,
+	[OP_ADDL] = OPP_VALID | OPP_RD | OPP_RS1 | OPP_ZF | OPP_INTFU,
+	[OP_SUBL] = OPP_VALID | OPP_RD | OPP_RS1 | OPP_ZF | OPP_INTFU,
+	[OP_LOAD] = OPP_VALID | OPP_RD | OPP_RS1 | OPP_MEM | OPP_INTFU, // intFU computes the address
+	[OP_STORE] = OPP_VALID | OPP_RS1 | OPP_RS2 | OPP_MEM | OPP_INTFU,
+	[OP_BZ] = OPP_VALID | OPP_READS_ZF | OPP_CF | OPP_INTFU,
+	[OP_BNZ] = OPP_VALID | OPP_READS_ZF | OPP_CF | OPP_INTFU,
+	[OP_JUMP] = OPP_VALID | OPP_RS1 | OPP_CF | OPP_INTFU,
+	[OP_JAL] = OPP_VALID | OPP_RD | OPP_RS1 | OPP_ZF | OPP_CF | OPP_INTFU, // saves the return address in rd
+	[OP_HALT] = OPP_VALID,
+};
+
+// operands of each opcode in source order ; d rd, s rs1, t rs2, i literal
+static const char* const operand_kinds[NUM_OPCODES] = {
+	[OP_NOP] = "",
+	[OP_ADD] = "dst",
+	[OP_SUB] = "dst",
+	[OP_AND] = "dst",
+	[OP_OR] = "dst",
+	[OP_XOR] = "dst",
+	[OP_MUL] = "dst",
+	[OP_MOVC] = "di",
+	[OP_ADDL] = "dsi",
+	[OP_SUBL] = "dsi",
+	[OP_LOAD] = "dsi",
+	[OP_STORE] = "tsi",
+	[OP_BZ] = "i",
+	[OP_BNZ] = "i",
+	[OP_JUMP] = "si",
+	[OP_JAL] = "dsi",
+	[OP_HALT] = "",
+};
+
+static opcode_t lookup_opcode(const char* str, int len) {
+	for(int op=OP_NOP; op<NUM_OPCODES; op++) {
+		if((int) strlen(opcode_names[op]) == len && strncasecmp(str, opcode_names[op], len) == 0) return op;
+	}
+	return OP_INVALID;
+}
+
+opcode_t decode_opcode(const char* str) {
+	return lookup_opcode(str, strlen(str));
+}
+
+// a piece of the source ; never copied, the text outlives the assembly
+typedef struct token_t {
+	const char* str;
+	int len;
+} token_t;
+
+typedef struct label_t {
+	token_t name; // len 0 if the hash slot is empty
+	int value; // insn address or data word address
+	int line;
+} label_t;
+
+// a literal that named a label not defined yet
+typedef struct fixup_t {
+	token_t name;
+	int line;
+	int idx; // insn or data word
+	char data;
+} fixup_t;
+
+typedef struct asm_t {
+	const char* name; // for error messages
+	int line;
+	int errors;
+	program_t* prog;
+	int code_cap;
+	int data_cap;
+	char in_data; // after .data, until .text
+	int data_ptr; // next data word
+
+	label_t* labels; // open addressing ; num_slots is a power of two, at most half full
+	int num_slots;
+	int num_labels;
+	fixup_t* fixups;
+	int num_fixups;
+	int fixups_cap;
+} asm_t;
+
+static void asm_error(asm_t* a, const char* fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	fprintf(stderr, "asm> %s:%d: ", a->name, a->line);
+	vfprintf(stderr, fmt, args);
+	fprintf(stderr, "\n");
+	va_end(args);
+	a->errors++;
+}
+
+// grows *array to hold at least n elements of size bytes, zero-filled ; -1 if out of memory or past INT_MAX elements
+static int reserve(void** array, int* cap, int n, size_t size) {
+	if(n <= *cap) return 0;
+	int64_t new_cap = *cap ? *cap : 64;
+	while(new_cap < n) new_cap *= 2;
+	if(new_cap > INT_MAX) return -1;
+	void* grown = realloc(*array, (size_t) new_cap * size);
+	if(!grown) return -1;
+	memset((char*) grown + (size_t) *cap * size, 0, (size_t) (new_cap - *cap) * size);
+	*array = grown;
+	*cap = (int) new_cap;
+	return 0;
+}
+
+static char is_blank(char c) {
+	return c == ' ' || c == '\t' || c == '\r' || c == ',';
+}
+
+// next token before end ; 0 at the end of the line
+static int next_token(const char** p, const char* end, token_t* tok) {
+	while(*p < end && is_blank(**p)) (*p)++;
+	if(*p == end) return 0;
+	tok->str = *p;
+	while(*p < end && !is_blank(**p)) (*p)++;
+	tok->len = *p - tok->str;
+	return 1;
+}
 
-static int str_to_int(char* buffer) {
-	char str[16];
-	int j = 0;
-	for(int i = 1; buffer[i] != '\0'; ++i) {
-		str[j] = buffer[i];
-		j++;
-	}
-	str[j] = '\0';
-	return atoi(str);
-}
-
-static void creat_insn(insn_t* ins, char* buffer) {
-	
-	char* token = strtok(buffer, ",");
-	int token_num = 0;
-	char tokens[6][128];
-	while (token != NULL) {
-		strcpy(tokens[token_num], token);
-		token_num++;
-		token = strtok(NULL, ",");
-	}
-	
-	strcpy(ins->opcode, tokens[0]);
-	ins->opcode[strcspn(ins->opcode, "\r\n")] = 0; // gets rid of new line, if exists (ex, HALT)	
-
-	// insn with only literal	
-	if(strcmp(ins->opcode, "MOVC") == 0) {
-		ins->rd = str_to_int(tokens[1]);
-		ins->imm = str_to_int(tokens[2]);
-	}	
-	if(strcmp(ins->opcode, "BZ") == 0 || strcmp(ins->opcode, "BNZ") == 0) {
-		ins->imm = str_to_int(tokens[1]);
-	}
-
-	// insn with register and literal	
-	if(strcmp(ins->opcode, "LOAD") == 0 || strcmp(ins->opcode, "ADDL") == 0 ||strcmp(ins->opcode, "SUBL") == 0 || strcmp(ins->opcode, "JAL") == 0) {
-		ins->rd = str_to_int(tokens[1]);
-		ins->rs1 = str_to_int(tokens[2]);
-		ins->imm = str_to_int(tokens[3]);
-	}
-	if(strcmp(ins->opcode, "STORE") == 0) {
-		ins->rs2 = str_to_int(tokens[1]);
-	 	ins->rs1 = str_to_int(tokens[2]);
-		ins->imm = str_to_int(tokens[3]);
-	}	
-	if(strcmp(ins->opcode, "JUMP") == 0) {
-		ins->rs1 = str_to_int(tokens[1]);
-		ins->imm = str_to_int(tokens[2]);
-	}	
-
-	// insn with only registers
-	if(	strcmp(ins->opcode, "ADD") == 0 ||
-		strcmp(ins->opcode, "SUB") == 0 ||
-		strcmp(ins->opcode, "AND") == 0 ||
-		strcmp(ins->opcode, "OR" ) == 0 ||
-		strcmp(ins->opcode, "XOR") == 0 ||
-		strcmp(ins->opcode, "MUL") == 0 ){
-		
-		ins->rd = str_to_int(tokens[1]);
-		ins->rs1 = str_to_int(tokens[2]);
-		ins->rs2 = str_to_int(tokens[3]);
-	}
-
-}
-
-/* Parses .asm file */
-insn_t* create_code(const char* filename, int* size) {
-
-	if(!filename) return NULL;
-	
-	FILE* fd = fopen(filename, "r");
-	if(!fd) return NULL;
-	
-	char* line = NULL;
-	size_t len = 0;
-	ssize_t nread;
-	int code_size = 0;
-	
-	while((nread = getline(&line, &len, fd)) != -1) {
-		code_size++;
-	}
-	*size = code_size;
-	if(!code_size) {
-		fclose(fd);
-		return NULL;
-	}
-	
-	insn_t* code = malloc(sizeof(*code) * code_size);
-	if(!code) {
-		fclose(fd);
-		return NULL;
-	}
-	
-	rewind(fd);
-	int insn = 0;
-	while( (nread = getline(&line, &len, fd)) != -1 ) {
-		creat_insn(&code[insn], line);
-		insn++;
-	}
-	
-	free(line);
-	fclose(fd);
-	return code;
+static char is_label_name(token_t t) {
+	if(!t.len || !(t.str[0] == '_' || t.str[0] == '.' || (t.str[0] >= 'A' && t.str[0] <= 'Z') || (t.str[0] >= 'a' && t.str[0] <= 'z'))) return 0;
+	for(int i=1; i<t.len; i++) {
+		char c = t.str[i];
+		if(!(c == '_' || c == '.' || (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z'))) return 0;
+	}
+	return 1;
+}
+
+static char is_register_name(token_t t) {
+	if(t.len < 2 || (t.str[0] != 'R' && t.str[0] != 'r')) return 0;
+	for(int i=1; i<t.len; i++) {
+		if(t.str[i] < '0' || t.str[i] > '9') return 0;
+	}
+	return 1;
+}
+
+// FNV-1a
+static unsigned int label_hash(token_t t) {
+	unsigned int h = 2166136261u;
+	for(int i=0; i<t.len; i++) {
+		h = (h ^ (unsigned char) t.str[i]) * 16777619u;
+	}
+	return h;
+}
+
+static label_t* label_slot(asm_t* a, token_t name) {
+	unsigned int i = label_hash(name) & (a->num_slots - 1);
+	while(a->labels[i].name.len && (a->labels[i].name.len != name.len || memcmp(a->labels[i].name.str, name.str, name.len))) {
+		i = (i + 1) & (a->num_slots - 1);
+	}
+	return &a->labels[i];
+}
+
+static void label_define(asm_t* a, token_t name, int value) {
+	if(!is_label_name(name) || is_register_name(name)) {
+		asm_error(a, "bad label name '%.*s'", name.len, name.str);
+		return;
+	}
+	if(2 * (a->num_labels + 1) > a->num_slots) { // rehash into twice the slots
+		label_t* old = a->labels;
+		int old_slots = a->num_slots;
+		a->num_slots = old_slots ? 2 * old_slots : 256;
+		a->labels = calloc(a->num_slots, sizeof(label_t));
+		if(!a->labels) {
+			a->labels = old;
+			a->num_slots = old_slots;
+			asm_error(a, "out of memory");
+			return;
+		}
+		for(int i=0; i<old_slots; i++) {
+			if(old[i].name.len) *label_slot(a, old[i].name) = old[i];
+		}
+		free(old);
+	}
+	label_t* l = label_slot(a, name);
+	if(l->name.len) {
+		asm_error(a, "label '%.*s' already defined on line %d", name.len, name.str, l->line);
+		return;
+	}
+	l->name = name;
+	l->value = value;
+	l->line = a->line;
+	a->num_labels++;
+}
+
+static int label_find(asm_t* a, token_t name, int* value) {
+	if(!a->num_slots) return -1;
+	label_t* l = label_slot(a, name);
+	if(!l->name.len) return -1;
+	*value = l->value;
+	return 0;
+}
+
+static char is_relative(opcode_t opcode) {
+	return opcode == OP_BZ || opcode == OP_BNZ;
+}
+
+static int insn_addr(int idx) {
+	return CODE_START_ADDR + 4 * idx;
+}
+
+// a number, or a label resolved now or at the end ; idx is the insn or data word it goes into
+static int literal(asm_t* a, token_t t, int idx, char data, int* value) {
+	if(t.len && t.str[0] == '#') {
+		t.str++;
+		t.len--;
+	}
+	if(!t.len) {
+		asm_error(a, "empty literal");
+		return -1;
+	}
+	if(is_register_name(t)) {
+		asm_error(a, "expected a literal, got '%.*s'", t.len, t.str);
+		return -1;
+	}
+	if(is_label_name(t)) {
+		int addr;
+		if(!label_find(a, t, &addr)) {
+			*value = (!data && is_relative(a->prog->code[idx].opcode)) ? addr - insn_addr(idx) : addr;
+			return 0;
+		}
+		if(reserve((void**) &a->fixups, &a->fixups_cap, a->num_fixups + 1, sizeof(fixup_t))) {
+			asm_error(a, "out of memory");
+			return -1;
+		}
+		a->fixups[a->num_fixups++] = (fixup_t) { t, a->line, idx, data };
+		*value = 0;
+		return 0;
+	}
+
+	char buf[32];
+	if(t.len >= (int) sizeof(buf)) {
+		asm_error(a, "bad literal '%.*s'", t.len, t.str);
+		return -1;
+	}
+	memcpy(buf, t.str, t.len);
+	buf[t.len] = '\0';
+	char* end;
+	errno = 0;
+	long v = strtol(buf, &end, 0);
+	if(*end || errno || v < INT_MIN || v > INT_MAX) {
+		asm_error(a, "bad literal '%.*s'", t.len, t.str);
+		return -1;
+	}
+	*value = (int) v;
+	return 0;
+}
+
+static int reg(asm_t* a, token_t t, int* r) {
+	int n = 0;
+	for(int i=1; i<t.len && n<NUM_ARCH_REGS; i++) { // the token is not terminated
+		n = 10 * n + t.str[i] - '0';
+	}
+	if(!is_register_name(t) || n >= NUM_ARCH_REGS) {
+		asm_error(a, "expected a register R0-R%d, got '%.*s'", NUM_ARCH_REGS - 1, t.len, t.str);
+		return -1;
+	}
+	*r = n;
+	return 0;
+}
+
+static void assemble_insn(asm_t* a, token_t op, const char** p, const char* end) {
+	opcode_t opcode = lookup_opcode(op.str, op.len);
+	if(opcode == OP_INVALID) {
+		asm_error(a, "unknown opcode '%.*s'", op.len, op.str);
+		return;
+	}
+	program_t* prog = a->prog;
+	if(reserve((void**) &prog->code, &a->code_cap, prog->code_size + 1, sizeof(insn_t))) {
+		asm_error(a, "out of memory");
+		return;
+	}
+	int idx = prog->code_size++;
+	insn_t* insn = &prog->code[idx];
+	insn->opcode = opcode;
+	insn->rd = insn->rs1 = insn->rs2 = -1; // unused operands ; the display leaves them out
+
+	const char* kinds = operand_kinds[opcode];
+	token_t t;
+	for(int k=0; kinds[k]; k++) {
+		if(!next_token(p, end, &t)) {
+			asm_error(a, "%s takes %d operand%s", opcode_names[opcode], (int) strlen(kinds), strlen(kinds) == 1 ? "" : "s");
+			return;
+		}
+		insn = &prog->code[idx];
+		switch(kinds[k]) {
+			case 'd': reg(a, t, &insn->rd); break;
+			case 's': reg(a, t, &insn->rs1); break;
+			case 't': reg(a, t, &insn->rs2); break;
+			case 'i': literal(a, t, idx, 0, &insn->imm); break;
+		}
+	}
+	if(next_token(p, end, &t)) asm_error(a, "%s takes %d operand%s, got more", opcode_names[opcode], (int) strlen(kinds), strlen(kinds) == 1 ? "" : "s");
+}
+
+static void data_word(asm_t* a, token_t t) {
+	program_t* prog = a->prog;
+	if(a->data_ptr >= MAX_MEM_SIZE) {
+		asm_error(a, ".data address %d out of range ; memory ends at %d", a->data_ptr, MAX_MEM_SIZE - 1);
+		return;
+	}
+	if(reserve((void**) &prog->data, &a->data_cap, a->data_ptr + 1, sizeof(int))) {
+		asm_error(a, "out of memory for .data");
+		return;
+	}
+	int idx = a->data_ptr++;
+	if(a->data_ptr > prog->data_size) prog->data_size = a->data_ptr;
+	literal(a, t, idx, 1, &prog->data[idx]);
+}
+
+static void directive(asm_t* a, token_t t, const char** p, const char* end) {
+	token_t arg;
+	if(t.len == 5 && !strncasecmp(t.str, ".data", 5)) {
+		a->in_data = 1;
+		if(next_token(p, end, &arg)) {
+			int addr;
+			token_t v = arg;
+			if(v.len && v.str[0] == '#') {
+				v.str++;
+				v.len--;
+			}
+			if(is_label_name(v)) asm_error(a, ".data takes a number, got '%.*s'", arg.len, arg.str);
+			else if(!literal(a, arg, -1, 1, &addr)) {
+				if(addr < 0) asm_error(a, ".data address %d is negative", addr);
+				else if(addr >= MAX_MEM_SIZE) asm_error(a, ".data address %d out of range ; memory ends at %d", addr, MAX_MEM_SIZE - 1);
+				else a->data_ptr = addr;
+			}
+		}
+	} else if(t.len == 5 && !strncasecmp(t.str, ".text", 5)) {
+		a->in_data = 0;
+	} else {
+		asm_error(a, "unknown directive '%.*s'", t.len, t.str);
+		return;
+	}
+	if(next_token(p, end, &arg)) asm_error(a, "unexpected '%.*s' after %.*s", arg.len, arg.str, t.len, t.str);
+}
+
+static void assemble_line(asm_t* a, const char* p, const char* end) {
+	for(const char* c=p; c<end; c++) { // drop the comment
+		if(*c == ';' || (*c == '/' && c + 1 < end && c[1] == '/')) {
+			end = c;
+			break;
+		}
+	}
+
+	token_t t;
+	if(!next_token(&p, end, &t)) return; // blank
+	while(t.len && t.str[t.len - 1] == ':') {
+		t.len--;
+		label_define(a, t, a->in_data ? a->data_ptr : insn_addr(a->prog->code_size));
+		if(!next_token(&p, end, &t)) return;
+	}
+
+	if(t.str[0] == '.') directive(a, t, &p, end);
+	else if(a->in_data) {
+		do {
+			data_word(a, t);
+		} while(next_token(&p, end, &t));
+	} else assemble_insn(a, t, &p, end);
+}
+
+int program_assemble(const char* text, size_t len, const char* name, program_t* prog) {
+	memset(prog, 0, sizeof(program_t));
+	asm_t a;
+	memset(&a, 0, sizeof(asm_t));
+	a.name = name;
+	a.prog = prog;
+
+	const char* end = text + len;
+	for(const char* p=text; p<end; ) {
+		const char* eol = memchr(p, '\n', end - p);
+		if(!eol) eol = end;
+		a.line++;
+		assemble_line(&a, p, eol);
+		p = eol + 1;
+	}
+
+	for(int i=0; i<a.num_fixups; i++) {
+		fixup_t* f = &a.fixups[i];
+		int addr;
+		a.line = f->line;
+		if(label_find(&a, f->name, &addr)) asm_error(&a, "undefined label '%.*s'", f->name.len, f->name.str);
+		else if(f->data) prog->data[f->idx] = addr;
+		else prog->code[f->idx].imm = is_relative(prog->code[f->idx].opcode) ? addr - insn_addr(f->idx) : addr;
+	}
+	if(!a.errors && !prog->code_size) {
+		fprintf(stderr, "asm> %s: no instructions\n", name);
+		a.errors++;
+	}
+
+	free(a.labels);
+	free(a.fixups);
+	if(a.errors) {
+		program_free(prog);
+		return -1;
+	}
+	return 0;
+}
+
+/* Parses .asm file ; mapped when it can be, read otherwise (a pipe) ; a program image stays mapped instead */
+int program_load(const char* filename, program_t* prog) {
+	memset(prog, 0, sizeof(program_t));
+	if(!filename) return -1;
+
+	int fd = open(filename, O_RDONLY);
+	if(fd < 0) {
+		fprintf(stderr, "asm> Could not open %s\n", filename);
+		return -1;
+	}
+	struct stat st;
+	if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+		void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(map != MAP_FAILED) {
+			close(fd);
+			if(st.st_size >= 4 && !memcmp(map, IMAGE_MAGIC, 4)) return image_open(map, st.st_size, filename, prog);
+			int ret = program_assemble(map, st.st_size, filename, prog);
+			munmap(map, st.st_size);
+			return ret;
+		}
+	}
+
+	char* text = NULL;
+	size_t len = 0, cap = 0;
+	ssize_t n;
+	do {
+		if(len == cap) {
+			cap = cap ? 2 * cap : 65536;
+			char* grown = realloc(text, cap);
+			if(!grown) {
+				free(text);
+				close(fd);
+				return -1;
+			}
+			text = grown;
+		}
+		n = read(fd, text + len, cap - len);
+		if(n > 0) len += n;
+	} while(n > 0);
+	close(fd);
+	if(n == 0 && len >= 4 && !memcmp(text, IMAGE_MAGIC, 4)) {
+		fprintf(stderr, "asm> %s: a program image has to be a regular file\n", filename);
+		n = -1;
+	}
+	int ret = n < 0 ? -1 : program_assemble(text, len, filename, prog);
+	free(text);
+	return ret;
+}
+
+void program_free(program_t* prog) {
+	if(prog->map) munmap(prog->map, prog->map_size);
+	else {
+		free(prog->code);
+		free(prog->data);
+	}
+	memset(prog, 0, sizeof(program_t));
 }
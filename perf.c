@@ -0,0 +1,101 @@
+/* Performance counters ; histograms are sized by the configuration */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "perf.h"
+
+static const char* const class_names[NUM_INSN_CLASSES] = { "alu", "mul", "load", "store", "branch", "halt" };
+static const char* const stall_names[NUM_STALLS] = { "none", "ureg", "rob_full", "iq_full", "lsq_full", "cfid", "int_fu_busy", "mul_fu_busy", "agu_busy", "mem_fu_busy", "mshr_full" };
+
+int perf_init(perf_t* perf, const config_t* config) {
+	memset(perf, 0, sizeof(perf_t));
+	perf->iq_size = config->iq_size;
+	perf->rob_size = config->rob_size;
+	perf->lsq_size = config->lsq_size;
+	perf->iq_hist = calloc(perf->iq_size + 1, sizeof(int));
+	perf->rob_hist = calloc(perf->rob_size + 1, sizeof(int));
+	perf->lsq_hist = calloc(perf->lsq_size + 1, sizeof(int));
+	if(!perf->iq_hist || !perf->rob_hist || !perf->lsq_hist) return -1;
+	return 0;
+}
+
+void perf_free(perf_t* perf) {
+	free(perf->lsq_hist);
+	free(perf->rob_hist);
+	free(perf->iq_hist);
+}
+
+void perf_sample(perf_t* perf, int iq_num, int rob_num, int lsq_num, int cycles) {
+	perf->cycles += cycles;
+	perf->iq_hist[iq_num] += cycles;
+	perf->rob_hist[rob_num] += cycles;
+	perf->lsq_hist[lsq_num] += cycles;
+}
+
+static double hist_mean(const int* hist, int size) {
+	double sum = 0;
+	int n = 0;
+	for(int i=0; i<=size; i++) {
+		sum += (double) i * hist[i];
+		n += hist[i];
+	}
+	return n ? sum / n : 0.0;
+}
+
+static void print_hist(const char* name, const int* hist, int size, int cycles, FILE* out) {
+	fprintf(out, "%-4s occupancy  mean %.2f of %d\n", name, hist_mean(hist, size), size);
+	for(int i=0; i<=size; i++) {
+		if(!hist[i]) continue; // most of a large queue is never reached
+		fprintf(out, "  %4d  %9d  %5.1f%%\n", i, hist[i], cycles ? 100.0 * hist[i] / cycles : 0.0);
+	}
+}
+
+void perf_print(const perf_t* perf, FILE* out) {
+	int total = 0;
+	for(int i=0; i<NUM_INSN_CLASSES; i++) {
+		total += perf->committed[i];
+	}
+	fprintf(out, "cycles            %d\n", perf->cycles);
+	fprintf(out, "committed         %d\n", total);
+	for(int i=0; i<NUM_INSN_CLASSES; i++) {
+		fprintf(out, "  %-15s %d\n", class_names[i], perf->committed[i]);
+	}
+	fprintf(out, "flushes           %d\n", perf->flushes);
+	fprintf(out, "squashed          %d\n", perf->squashed);
+	fprintf(out, "forwarded loads   %d\n", perf->forwarded);
+	fprintf(out, "order flushes     %d\n", perf->order_flushes);
+	fprintf(out, "stall cycles\n");
+	for(int i=STALL_NONE+1; i<NUM_STALLS; i++) {
+		fprintf(out, "  %-15s %-9d %5.1f%%\n", stall_names[i], perf->stalls[i], perf->cycles ? 100.0 * perf->stalls[i] / perf->cycles : 0.0);
+	}
+	print_hist("IQ", perf->iq_hist, perf->iq_size, perf->cycles, out);
+	print_hist("ROB", perf->rob_hist, perf->rob_size, perf->cycles, out);
+	print_hist("LSQ", perf->lsq_hist, perf->lsq_size, perf->cycles, out);
+}
+
+static void json_hist(const char* name, const int* hist, int size, FILE* out) {
+	fprintf(out, "\"%s\": [", name);
+	for(int i=0; i<=size; i++) {
+		fprintf(out, "%s%d", i ? ", " : "", hist[i]);
+	}
+	fprintf(out, "]");
+}
+
+void perf_json(const perf_t* perf, FILE* out) {
+	fprintf(out, "{\"committed\": {");
+	for(int i=0; i<NUM_INSN_CLASSES; i++) {
+		fprintf(out, "%s\"%s\": %d", i ? ", " : "", class_names[i], perf->committed[i]);
+	}
+	fprintf(out, "}, \"flushes\": %d, \"squashed\": %d, \"forwarded\": %d, \"order_flushes\": %d, \"stalls\": {", perf->flushes, perf->squashed, perf->forwarded, perf->order_flushes);
+	for(int i=STALL_NONE+1; i<NUM_STALLS; i++) {
+		fprintf(out, "%s\"%s\": %d", i > STALL_NONE+1 ? ", " : "", stall_names[i], perf->stalls[i]);
+	}
+	fprintf(out, "}, ");
+	json_hist("iq_occupancy", perf->iq_hist, perf->iq_size, out);
+	fprintf(out, ", ");
+	json_hist("rob_occupancy", perf->rob_hist, perf->rob_size, out);
+	fprintf(out, ", ");
+	json_hist("lsq_occupancy", perf->lsq_hist, perf->lsq_size, out);
+	fprintf(out, "}");
+}
@@ -0,0 +1,57 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdio.h> // FILE
+
+#include "config.h"
+
+/*
+
+	Performance counters ; updated by the pipeline stages, reported at the end of a run
+
+*/
+
+// committed insn by class
+enum { CLS_ALU, CLS_MUL, CLS_LOAD, CLS_STORE, CLS_BRANCH, CLS_HALT, NUM_INSN_CLASSES };
+
+// why a stage could not make progress in a cycle ; STALL_NONE is never counted
+enum {
+	STALL_NONE,
+	STALL_UREG, // decode ; not enough free unified registers for the group
+	STALL_ROB, // dispatch ; structure full
+	STALL_IQ,
+	STALL_LSQ,
+	STALL_CFID,
+	STALL_INT_FU, // issue ; a ready insn found every FU of its type busy
+	STALL_MUL_FU,
+	STALL_AGU,
+	STALL_MEM_FU, // memory ; the LSQ head was ready but memFU was busy
+	STALL_MSHR, // memory ; an L1D miss found every MSHR busy
+	NUM_STALLS
+};
+
+typedef struct perf_t {
+	int cycles; // sampled cycles
+	int committed[NUM_INSN_CLASSES];
+	int flushes; // mispredicted control-flow insn
+	int squashed; // younger insn thrown away by those flushes
+	int forwarded; // LOADs that took their value from an older STORE in the LSQ
+	int order_flushes; // LOADs that went past an older STORE to the same address ; at commit, everything younger is flushed and the LOAD goes again
+	int stalls[NUM_STALLS]; // cycles
+
+	// occupancy histograms ; entry n counts the cycles with n entries in use
+	int* iq_hist; // iq_size + 1 entries
+	int* rob_hist;
+	int* lsq_hist;
+	int iq_size;
+	int rob_size;
+	int lsq_size;
+} perf_t;
+
+int perf_init(perf_t* perf, const config_t* config); // 0 on success
+void perf_free(perf_t* perf);
+void perf_sample(perf_t* perf, int iq_num, int rob_num, int lsq_num, int cycles); // once per cycle ; cycles > 1 for a run of idle cycles with the same occupancy
+void perf_print(const perf_t* perf, FILE* out); // human-readable report
+void perf_json(const perf_t* perf, FILE* out); // one JSON object
+
+#endif // PERF_H
@@ -8,42 +8,54 @@
 
 void print_insn(stage_t* stage, char rename) {
 
-	// no operand insn
-	if(strcmp(stage->opcode, "NOP") == 0 || strcmp(stage->opcode, "HALT") == 0) printf("%s ", stage->opcode);
+	const char* op = opcode_names[stage->opcode];
+	switch(stage->opcode) {
+		// no operand insn
+		case OP_NOP:
+		case OP_HALT:
+			printf("%s ", op);
+			break;
 
-	if(strcmp(stage->opcode, "MOVC") == 0) {
-		printf("%s,R%d,#%d ", stage->opcode, stage->rd, stage->imm);
-		if(rename) printf("(%s,U%d,#%d) ", stage->opcode, stage->u_rd, stage->imm);
-	}
-	if(strcmp(stage->opcode, "BZ") == 0 || strcmp(stage->opcode, "BNZ") == 0) {
-		printf("%s,#%d ", stage->opcode, stage->imm);
-		if(rename) printf("(%s,#%d) ", stage->opcode, stage->imm);
-	}
+		case OP_MOVC:
+			printf("%s,R%d,#%d ", op, stage->rd, stage->imm);
+			if(rename) printf("(%s,U%d,#%d) ", op, stage->u_rd, stage->imm);
+			break;
+		case OP_BZ:
+		case OP_BNZ:
+			printf("%s,#%d ", op, stage->imm);
+			if(rename) printf("(%s,#%d) ", op, stage->imm);
+			break;
 
-	// insn with register and literal	
-	if(strcmp(stage->opcode, "LOAD") == 0 || strcmp(stage->opcode, "ADDL") == 0 ||strcmp(stage->opcode, "SUBL") == 0 || strcmp(stage->opcode, "JAL") == 0) {
-		printf("%s,R%d,R%d,#%d ", stage->opcode, stage->rd, stage->rs1, stage->imm);
-		if(rename) printf("(%s,U%d,U%d,#%d) ", stage->opcode, stage->u_rd, stage->u_rs1, stage->imm);
-	}
-	if(strcmp(stage->opcode, "STORE") == 0) {
-		printf("%s,R%d,R%d,#%d ", stage->opcode, stage->rs2, stage->rs1, stage->imm);
-		if(rename) printf("(%s,U%d,U%d,#%d) ", stage->opcode, stage->u_rs2, stage->u_rs1, stage->imm);
-	}	
-	if(strcmp(stage->opcode, "JUMP") == 0) {
-		printf("%s,R%d,#%d ", stage->opcode, stage->rs1, stage->imm);
-		if(rename) printf("(%s,U%d,#%d) ", stage->opcode, stage->u_rs1, stage->imm);
-	}	
+		// insn with register and literal	
+		case OP_LOAD:
+		case OP_ADDL:
+		case OP_SUBL:
+		case OP_JAL:
+			printf("%s,R%d,R%d,#%d ", op, stage->rd, stage->rs1, stage->imm);
+			if(rename) printf("(%s,U%d,U%d,#%d) ", op, stage->u_rd, stage->u_rs1, stage->imm);
+			break;
+		case OP_STORE:
+			printf("%s,R%d,R%d,#%d ", op, stage->rs2, stage->rs1, stage->imm);
+			if(rename) printf("(%s,U%d,U%d,#%d) ", op, stage->u_rs2, stage->u_rs1, stage->imm);
+			break;
+		case OP_JUMP:
+			printf("%s,R%d,#%d ", op, stage->rs1, stage->imm);
+			if(rename) printf("(%s,U%d,#%d) ", op, stage->u_rs1, stage->imm);
+			break;
+
+		// insn with only registers
+		case OP_ADD:
+		case OP_SUB:
+		case OP_AND:
+		case OP_OR:
+		case OP_XOR:
+		case OP_MUL:
+			printf("%s,R%d,R%d,R%d ", op, stage->rd, stage->rs1, stage->rs2);
+			if(rename) printf("(%s,U%d,U%d,U%d) ", op, stage->u_rd, stage->u_rs1, stage->u_rs2);
+			break;
 
-	// insn with only registers
-	if(	strcmp(stage->opcode, "ADD") == 0 ||
-		strcmp(stage->opcode, "SUB") == 0 ||
-		strcmp(stage->opcode, "AND") == 0 ||
-		strcmp(stage->opcode, "OR" ) == 0 ||
-		strcmp(stage->opcode, "XOR") == 0 ||
-		strcmp(stage->opcode, "MUL") == 0 ){
-		
-		printf("%s,R%d,R%d,R%d ", stage->opcode, stage->rd, stage->rs1, stage->rs2);
-		if(rename) printf("(%s,U%d,U%d,U%d) ", stage->opcode, stage->u_rd, stage->u_rs1, stage->u_rs2);
+		default:
+			break;
 	}
 
 }
@@ -52,7 +64,7 @@ void print_stage_content(char* name, stage_t* stage) {
 	printf("%-15s: pc(%d) ", name, stage->pc);
 	char rename = !strcmp(name, "Fetch") == 0;
 	print_insn(stage, rename);	
-	if(strcmp(name, "intFU") == 0 || strcmp(name, "mulFU") == 0 || strcmp(name, "memFU") == 0 ) {
+	if(strncmp(name, "intFU", 5) == 0 || strncmp(name, "mulFU", 5) == 0 || strncmp(name, "aguFU", 5) == 0 || strcmp(name, "memFU") == 0 ) {
 		if(stage->cfid != -1) printf("cfid %i ", stage->cfid);
 		if(stage->busy > 0) {
 		//	int lat;
@@ -78,13 +90,14 @@ void print_rename_table(cpu_t* cpu) {
 	printf("\n");
 }
 
-void print_iq(iq_entry_t* iq) {
+void print_iq(cpu_t* cpu) {
 	printf("---Instruction Queue---\n");
 
 	printf("%-9s %-9s %-9s %-9s %-9s %-9s %-9s %-9s %-9s %-9s %-9s %-9s %-9s %-9s %-9s\n", "index", "taken", "dispatch", "cfid", "pc", "opcode", "rs1", "rs1_rdy", "rs1_val", "rs2", "rs2_rdy", "rs2_val", "imm", "z_ud", "z_rdy");
-	for(int i=0; i<IQ_SIZE; i++) {
-		iq_entry_t* iqe = &iq[i];
-		if(iqe->taken) printf("%-9i %-9i %-9i %-9i %-9i %-9s %-9i %-9i %-9i %-9i %-9i %-9i %-9i %-9i %-9i\n", i, iqe->taken, iqe->cycle_dispatched, iqe->cfid, iqe->pc, iqe->opcode, iqe->u_rs1, iqe->u_rs1_ready, iqe->u_rs1_val, iqe->u_rs2, iqe->u_rs2_ready, iqe->u_rs2_val, iqe->imm, iqe->zero_flag_u_rd, iqe->zero_flag_ready);	
+	for(int i=0; i<cpu->config.iq_size; i++) {
+		iq_entry_t* iqe = &cpu->iq[i];
+		char taken = !bitmap_test(cpu->iq_free, i);
+		if(taken) printf("%-9i %-9i %-9i %-9i %-9i %-9s %-9i %-9i %-9i %-9i %-9i %-9i %-9i %-9i %-9i\n", i, taken, iqe->cycle_dispatched, cpu->iq_cfid[i], iqe->pc, opcode_names[iqe->opcode], iqe->u_rs1, iqe->u_rs1_ready, iqe->u_rs1_val, iqe->u_rs2, iqe->u_rs2_ready, iqe->u_rs2_val, iqe->imm, iqe->zero_flag_u_rd, iqe->zero_flag_ready);	
 	}
 	printf("\n");
 }
@@ -92,9 +105,9 @@ void print_iq(iq_entry_t* iq) {
 void print_memory(cpu_t* cpu) {
 	printf("---Data memory---\n");
 	int bytes_per_line = 64;	
-	for(int i=0; i<4000; i+=bytes_per_line) {
+	for(int i=0; i<cpu->config.mem_size; i+=bytes_per_line) {
 		printf("%-4i: ", i);
-		for(int j=0; j<bytes_per_line; j++) { // print 4 bytes per line
+		for(int j=0; j<bytes_per_line && i + j < cpu->config.mem_size; j++) { // print 4 bytes per line
 			printf("%i ", cpu->memory[i + j]);
 		}
 		printf("\n");	
@@ -108,9 +121,9 @@ void print_lsq(lsq_t* lsq) {
 	printf("%-9i %-9i\n", lsq->head_ptr, lsq->tail_ptr);
 
 	printf("%-9s %-9s %-9s %-9s %-9s %-9s %-9s %-9s %-9s %-9s\n", "index", "cfid", "pc", "opcode", "valid", "mem_addr", "rd", "rs2_rdy", "rs2", "rs2_val");
-	for(int i=0; i<LSQ_SIZE; i++) {
+	for(int i=0; i<lsq->size; i++) {
 		lsq_entry_t* l = &lsq->entries[i];
-		if(l->taken) printf("%-9i %-9i %-9i %-9s %-9i %-9i %-9i %-9i %-9i %-9i\n", i, l->cfid, l->pc, l->opcode, l->mem_addr_valid, l->mem_addr, l->u_rd, l->u_rs2_ready, l->u_rs2, l->u_rs2_val);	
+		if(bitmap_test(lsq->taken, i)) printf("%-9i %-9i %-9i %-9s %-9i %-9i %-9i %-9i %-9i %-9i\n", i, lsq->cfid[i], l->pc, opcode_names[l->opcode], l->mem_addr_valid, l->mem_addr, l->u_rd, l->u_rs2_ready, l->u_rs2, l->u_rs2_val);	
 	}
 	printf("\n");
 }
@@ -121,17 +134,17 @@ void print_rob(rob_t* rob) {
 	printf("%-9i %-9i\n", rob->head_ptr, rob->tail_ptr);
 
 	printf("%-9s %-9s %-9s %-9s %-9s %-9s %-9s\n", "index", "valid", "cfid", "pc", "opcode", "rd", "lsq_idx");
-	for(int i=0; i<ROB_SIZE; i++) {
+	for(int i=0; i<rob->size; i++) {
 		rob_entry_t* r = &rob->entries[i];
-		if(r->taken) printf("%-9i %-9i %-9i %-9i %-9s %-9i %-9i\n", i, r->valid, r->cfid, r->pc, r->opcode, r->u_rd, r->lsq_idx);	
+		if(bitmap_test(rob->taken, i)) printf("%-9i %-9i %-9i %-9i %-9s %-9i %-9i\n", i, r->valid, rob->cfid[i], r->pc, opcode_names[r->opcode], r->u_rd, r->lsq_idx);	
 	}
 	printf("\n");
 }
 
-void print_unified_regs(ureg_t* regs) {
+void print_unified_regs(ureg_t* regs, int size) {
 	printf("---Unified Registers---\n");
 	printf("%-9s %-9s %-9s %-9s %-9s\n", "reg", "taken", "valid", "value", "zero");
-	for(int i=0; i<NUM_UNIFIED_REGS; i++) {
+	for(int i=0; i<size; i++) {
 		printf("U%-9i %-9i %-9i %-9i %-9i\n", i, regs[i].taken, regs[i].valid, regs[i].val, regs[i].zero_flag);
 	}
 	printf("\n");	
@@ -150,39 +163,52 @@ void print_arch_regs(areg_t* regs) {
 	printf("\n");	
 }
 
-void print_all_FU(cpu_t* cpu) {
-
-	fu_t* intFU = &cpu->intFU;
-	fu_t* mulFU = &cpu->mulFU;
-	fu_t* memFU = &cpu->memFU;
+// FUs with several instances are numbered (intFU0, intFU1, ...)
+static void print_FU(cpu_t* cpu, const char* name, fu_t* fu, int idx, int num) {
+	char label[32];
+	if(num > 1) snprintf(label, sizeof(label), "%s%d", name, idx);
+	else snprintf(label, sizeof(label), "%s", name);
 
-	printf("---Functional Units---\n");
-	stage_t* stage = &cpu->print_info[intFU->print_idx];
-	stage->busy = intFU->busy;
+	stage_t* stage = &cpu->print_info[fu->print_idx];
+	stage->busy = fu->busy;
 	if(stage->busy < 0) stage = &cpu->print_info[cpu->code_size]; // NOP	
-	print_stage_content("intFU", stage);
+	print_stage_content(label, stage);
+}
 
-	stage = &cpu->print_info[mulFU->print_idx];
-	stage->busy = mulFU->busy;
-	if(stage->busy < 0) stage = &cpu->print_info[cpu->code_size]; // NOP	
-	print_stage_content("mulFU", stage);
+void print_all_FU(cpu_t* cpu) {
+
+	printf("---Functional Units---\n");
+	static const char* const pool_names[NUM_FU_TYPES] = { "intFU", "mulFU", "aguFU" };
+	for(int t=0; t<NUM_FU_TYPES; t++) {
+		fu_pool_t* pool = &cpu->fu[t];
+		for(int u=0; u<pool->units; u++) { // the insn each unit started last
+			fu_t* fu = &pool->slots[u];
+			for(int s=u; s<pool->units * pool->depth; s+=pool->units) {
+				if(pool->slots[s].busy > fu->busy) fu = &pool->slots[s];
+			}
+			print_FU(cpu, pool_names[t], fu, u, pool->units);
+		}
+	}
 	
 	printf("---Memory Function Unit---\n");
-	stage = &cpu->print_info[memFU->print_idx];
-	stage->busy = memFU->busy;
-	if(stage->busy < 0) stage = &cpu->print_info[cpu->code_size]; // NOP	
-	print_stage_content("memFU", stage);
+	for(int p=0; p<cpu->mem_ports; p++) { // the access each port started last
+		fu_t* fu = &cpu->memFU[p];
+		for(int s=p; s<cpu->mem_slots; s+=cpu->mem_ports) {
+			if(cpu->memFU[s].busy > fu->busy) fu = &cpu->memFU[s];
+		}
+		print_FU(cpu, "memFU", fu, p, cpu->mem_ports);
+	}
 	
 	printf("\n");
 }
 
 void print_cpu(cpu_t* cpu) {
-	print_unified_regs(cpu->unified_regs);	
+	print_unified_regs(cpu->unified_regs, cpu->config.num_unified_regs);	
 	print_rename_table(cpu);
 	
 	print_rob(&cpu->rob);
 	print_lsq(&cpu->lsq);
-	print_iq(cpu->iq);	
+	print_iq(cpu);	
 	if(cpu->print_memory || cpu->done) print_memory(cpu); // only print mem when updated or last cycle to display
 
 	print_all_FU(cpu);	
@@ -195,7 +221,7 @@ void print_code(cpu_t* cpu) {
 	for (int i = 0; i < cpu->code_size; ++i) {
 		printf("%-9d %-9s %-9d %-9d %-9d %-9d\n",
 		CODE_START_ADDR + i*4,
-		cpu->code[i].opcode,
+		opcode_names[cpu->code[i].opcode],
 		cpu->code[i].rd,
 		cpu->code[i].rs1,
 		cpu->code[i].rs2,
@@ -204,6 +230,42 @@ void print_code(cpu_t* cpu) {
 
 } 
 
+// one JSON record per run ; architectural state, registers never written are null, and the counters if asked for
+void print_summary(cpu_t* cpu, const char* program, char perf, FILE* out) {
+	double ipc = cpu->clock ? (double) cpu->committed / cpu->clock : 0.0;
+	fprintf(out, "{\"program\": \"%s\", \"cycles\": %d, \"committed\": %d, \"ipc\": %.4f, \"completed\": %s, \"mispredicts\": %d, ", program, cpu->clock, cpu->committed, ipc, cpu->done ? "true" : "false", cpu->bpred.mispredicts);
+	if(cpu->fast_forwarded) fprintf(out, "\"fast_forwarded\": %d, ", cpu->fast_forwarded);
+
+	fprintf(out, "\"regs\": [");
+	for(int i=0; i<NUM_ARCH_REGS; i++) {
+		int u_rd = cpu->arch_regs[i].u_rd;
+		if(u_rd == -1) fprintf(out, "null");
+		else fprintf(out, "%d", cpu->unified_regs[u_rd].val);
+		if(i < NUM_ARCH_REGS - 1) fprintf(out, ", ");
+	}
+	fprintf(out, "], ");
+
+	// memory is sparse ; only non-zero words
+	fprintf(out, "\"memory\": {");
+	char first = 1;
+	for(int i=0; i<cpu->config.mem_size; i++) {
+		if(!cpu->memory[i]) continue;
+		fprintf(out, "%s\"%d\": %d", first ? "" : ", ", i, cpu->memory[i]);
+		first = 0;
+	}
+	fprintf(out, "}");
+
+	if(perf) {
+		fprintf(out, ", \"perf\": ");
+		perf_json(&cpu->perf, out);
+	}
+	if(cpu->cache.levels) {
+		fprintf(out, ", \"cache\": ");
+		cache_json(&cpu->cache, out);
+	}
+	fprintf(out, "}\n");
+}
+
 void display(cpu_t* cpu) {	
 	printf("--------------------------------\n");
 	printf("Clock Cycle # %d\n", cpu->clock);
@@ -221,6 +283,7 @@ void display(cpu_t* cpu) {
 }
 
 void update_print_stack(char* name, cpu_t* cpu, int idx) {		
+	if(cpu->batch) return;
 	strcpy(cpu->print_stack[cpu->print_stack_ptr].name, name); // name of stage/FU
 	cpu->print_stack[cpu->print_stack_ptr].idx = idx;
 	cpu->print_stack_ptr++;
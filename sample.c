@@ -0,0 +1,289 @@
+/* Sampled simulation ; profiles a program functionally, simulates its simulation points in detail and extrapolates */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+#include <pthread.h>
+#include <unistd.h> // sysconf()
+
+#include "cpu.h"
+#include "config.h"
+#include "simpoint.h"
+
+// one interval simulated in detail ; job 0 is the full run when validating
+typedef struct job_t {
+	int interval; // -1 for the full run
+	int cycles; // measured after the warmup
+	int committed;
+	char failed;
+} job_t;
+
+// shared by every worker ; next_job is the only field written after start
+typedef struct sample_t {
+	program_t prog;
+	config_t config;
+	const bbv_t* bbv;
+	int warmup; // insn simulated in detail before an interval, not measured
+
+	job_t* jobs;
+	int num_jobs;
+
+	pthread_mutex_t lock;
+	int next_job;
+} sample_t;
+
+void print_args() {
+	printf("./sample [--interval N] [--max-k N] [--samples N] [--warmup N] [--max-insn N] [--seed N] [--threads N] [--validate] [--output file.json] [--config file] [--<key> <value>] <file.asm>\n");
+	printf("  --interval   insn per interval (10000)\n");
+	printf("  --max-k      most clusters tried (10) ; the BIC picks the number\n");
+	printf("  --samples    intervals simulated per cluster (2) ; more than one gives the error bound\n");
+	printf("  --warmup     insn simulated in detail before each interval, not measured (interval)\n");
+	printf("  --max-insn   stop profiling after this many insn (0 for the whole program)\n");
+	printf("  --validate   also simulate the whole program in detail and report the error\n");
+}
+
+// a machine that deadlocks must not stall the others ; no insn takes this long
+static int cycle_limit(int clock, int insn) {
+	long limit = clock + 100L * insn + 1000;
+	return limit > INT_MAX ? INT_MAX : (int) limit;
+}
+
+// detailed simulation of one interval, or of everything up to total_insn
+static void run_job(sample_t* sample, job_t* job) {
+	cpu_t* cpu = cpu_init_program(&sample->prog, &sample->config, 1);
+	if(!cpu) {
+		job->failed = 1;
+		return;
+	}
+
+	int start = 0, length = sample->bbv->total_insn, warm = 0;
+	if(job->interval >= 0) {
+		start = job->interval * sample->bbv->interval;
+		length = sample->bbv->lengths[job->interval];
+		warm = start < sample->warmup ? start : sample->warmup;
+	}
+	if(start - warm > 0 && cpu_fast_forward(cpu, start - warm, -1) < 0) {
+		job->failed = 1;
+		cpu_stop(cpu);
+		return;
+	}
+
+	if(warm && !cpu->done) {
+		cpu->stop_insn = warm;
+		cpu->stop_cycle = cycle_limit(cpu->clock, warm);
+		cpu_run(cpu, "simulate");
+	}
+	int clock = cpu->clock;
+	int committed = cpu->committed;
+	if(!cpu->done) {
+		cpu->stop_insn = warm + length;
+		cpu->stop_cycle = cycle_limit(cpu->clock, length);
+		cpu_run(cpu, "simulate");
+	}
+	job->cycles = cpu->clock - clock;
+	job->committed = cpu->committed - committed;
+	if(!job->committed || (cpu->committed < warm + length && !cpu->done)) job->failed = 1;
+	cpu_stop(cpu);
+}
+
+static void* worker(void* arg) {
+	sample_t* sample = arg;
+	while(1) {
+		pthread_mutex_lock(&sample->lock);
+		int idx = sample->next_job++;
+		pthread_mutex_unlock(&sample->lock);
+		if(idx >= sample->num_jobs) break;
+		run_job(sample, &sample->jobs[idx]);
+	}
+	return NULL;
+}
+
+// up to samples intervals of cluster c, the representative first ; the others at random
+static int pick_intervals(const simpoint_t* sp, const bbv_t* bbv, int c, int samples, unsigned int* state, int* picked) {
+	int num = 0;
+	if(sp->rep[c] == -1) return 0; // empty cluster
+	picked[num++] = sp->rep[c];
+
+	int members = 0;
+	for(int i=0; i<bbv->num_intervals; i++) {
+		if(sp->cluster[i] == c && i != sp->rep[c]) members++;
+	}
+	// selection sampling ; each remaining member is taken with probability needed / left
+	for(int i=0; i<bbv->num_intervals && num < samples && members; i++) {
+		if(sp->cluster[i] != c || i == sp->rep[c]) continue;
+		*state = *state * 1103515245 + 12345;
+		if((int) ((*state >> 8) % members) < samples - num) picked[num++] = i;
+		members--;
+	}
+	return num;
+}
+
+int main(int argc, char* argv[]) {
+	int num_threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	int interval = 10000;
+	int max_k = 10;
+	int samples = 2;
+	int warmup = -1; // one interval
+	int max_insn = 0;
+	unsigned int seed = 42;
+	char validate = 0;
+	const char* output = NULL;
+	const char* filename = NULL;
+
+	config_t config;
+	config_default(&config);
+
+	for(int i=1; i<argc; i++) {
+		if(strcmp(argv[i], "--threads") == 0 && i+1 < argc) num_threads = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--interval") == 0 && i+1 < argc) interval = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--max-k") == 0 && i+1 < argc) max_k = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--samples") == 0 && i+1 < argc) samples = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--warmup") == 0 && i+1 < argc) warmup = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--max-insn") == 0 && i+1 < argc) max_insn = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--seed") == 0 && i+1 < argc) seed = (unsigned int) strtoul(argv[++i], NULL, 0);
+		else if(strcmp(argv[i], "--validate") == 0) validate = 1;
+		else if(strcmp(argv[i], "--output") == 0 && i+1 < argc) output = argv[++i];
+		else if(strcmp(argv[i], "--config") == 0 && i+1 < argc) {
+			if(config_load(&config, argv[++i])) exit(1);
+		}
+		else if(strncmp(argv[i], "--", 2) == 0 && i+1 < argc && config_set(&config, argv[i] + 2, argv[i+1]) == 0) i++;
+		else if(argv[i][0] != '-' && !filename) filename = argv[i];
+		else {
+			print_args();
+			exit(1);
+		}
+	}
+	if(!filename || interval <= 0 || samples < 1) {
+		print_args();
+		exit(1);
+	}
+	if(num_threads < 1) num_threads = 1;
+	if(warmup < 0) warmup = interval;
+
+	sample_t sample;
+	if(program_load(filename, &sample.prog)) {
+		fprintf(stderr, "sample> Failed to load %s\n", filename);
+		exit(1);
+	}
+	sample.config = config;
+	sample.warmup = warmup;
+
+	// functional profile ; its cpu is only used for the memory image
+	bbv_t bbv;
+	cpu_t* cpu = cpu_init_program(&sample.prog, &config, 1);
+	if(!cpu || cpu_profile(cpu, interval, max_insn, &bbv) || !bbv.total_insn) {
+		fprintf(stderr, "sample> Failed to profile %s\n", filename);
+		exit(1);
+	}
+	cpu_stop(cpu);
+	sample.bbv = &bbv;
+
+	simpoint_t sp;
+	if(simpoint_cluster(&bbv, max_k, seed, &sp)) {
+		fprintf(stderr, "sample> Failed to cluster %s\n", filename);
+		exit(1);
+	}
+
+	// picked[c * samples + m] is the job index of the m-th interval of cluster c
+	int* num_picked = calloc(sp.k, sizeof(int));
+	int* picked = malloc(sp.k * samples * sizeof(int));
+	sample.jobs = calloc(sp.k * samples + 1, sizeof(job_t));
+	if(!num_picked || !picked || !sample.jobs) exit(1);
+	sample.num_jobs = 0;
+	if(validate) sample.jobs[sample.num_jobs++].interval = -1; // the longest ; started first
+	unsigned int state = seed;
+	for(int c=0; c<sp.k; c++) {
+		num_picked[c] = pick_intervals(&sp, &bbv, c, samples, &state, &picked[c * samples]);
+		for(int m=0; m<num_picked[c]; m++) {
+			sample.jobs[sample.num_jobs].interval = picked[c * samples + m];
+			picked[c * samples + m] = sample.num_jobs++;
+		}
+	}
+
+	pthread_mutex_init(&sample.lock, NULL);
+	sample.next_job = 0;
+	if(num_threads > sample.num_jobs) num_threads = sample.num_jobs;
+	pthread_t* threads = malloc(num_threads * sizeof(pthread_t));
+	for(int t=0; t<num_threads; t++) {
+		pthread_create(&threads[t], NULL, worker, &sample);
+	}
+	for(int t=0; t<num_threads; t++) {
+		pthread_join(threads[t], NULL);
+	}
+	pthread_mutex_destroy(&sample.lock);
+
+	// stratified estimate ; each cluster is a stratum weighted by its insn, its intervals a sample of it
+	double cpi = 0.0, var = 0.0;
+	char bounded = 1, failed = 0;
+	long detail_insn = 0;
+	for(int c=0; c<sp.k; c++) {
+		if(!num_picked[c]) continue;
+		double sum = 0.0, sum2 = 0.0;
+		for(int m=0; m<num_picked[c]; m++) {
+			job_t* job = &sample.jobs[picked[c * samples + m]];
+			if(job->failed) failed = 1;
+			double job_cpi = job->committed ? (double) job->cycles / job->committed : 0.0;
+			sum += job_cpi;
+			sum2 += job_cpi * job_cpi;
+			int start = job->interval * bbv.interval;
+			detail_insn += (start < warmup ? start : warmup) + bbv.lengths[job->interval];
+		}
+		int m = num_picked[c];
+		double mean = sum / m;
+		cpi += sp.weight[c] * mean;
+
+		int size = 0;
+		for(int i=0; i<bbv.num_intervals; i++) {
+			if(sp.cluster[i] == c) size++;
+		}
+		if(m == size) continue; // every interval simulated ; no sampling error
+		if(m < 2) {
+			bounded = 0;
+			continue;
+		}
+		double s2 = (sum2 - m * mean * mean) / (m - 1);
+		if(s2 < 0.0) s2 = 0.0;
+		var += sp.weight[c] * sp.weight[c] * s2 / m * (1.0 - (double) m / size);
+	}
+	if(failed) fprintf(stderr, "sample> Some intervals did not finish ; the estimate is off\n");
+
+	FILE* out = stdout;
+	if(output) {
+		out = fopen(output, "w");
+		if(!out) {
+			fprintf(stderr, "sample> Could not open %s\n", output);
+			exit(1);
+		}
+	}
+	double cycles = cpi * bbv.total_insn;
+	fprintf(out, "{\"program\": \"%s\", \"insn\": %d, \"completed\": %s, \"interval\": %d, \"intervals\": %d, \"k\": %d, ", filename, bbv.total_insn, bbv.completed ? "true" : "false", bbv.interval, bbv.num_intervals, sp.k);
+	fprintf(out, "\"points\": [");
+	char first = 1;
+	for(int c=0; c<sp.k; c++) {
+		if(!num_picked[c]) continue;
+		job_t* job = &sample.jobs[picked[c * samples]];
+		fprintf(out, "%s{\"interval\": %d, \"weight\": %.4f, \"cpi\": %.4f}", first ? "" : ", ", job->interval, sp.weight[c], job->committed ? (double) job->cycles / job->committed : 0.0);
+		first = 0;
+	}
+	fprintf(out, "], \"detail_insn\": %ld, \"cycles\": %.0f, \"ipc\": %.4f, ", detail_insn, cycles, cpi > 0.0 ? 1.0 / cpi : 0.0);
+	if(bounded) fprintf(out, "\"cycles_ci95\": %.0f", 1.96 * sqrt(var) * bbv.total_insn); // normal approximation
+	else fprintf(out, "\"cycles_ci95\": null");
+	if(validate) {
+		job_t* full = &sample.jobs[0];
+		double error = full->cycles ? (cycles - full->cycles) / full->cycles : 0.0;
+		fprintf(out, ", \"full_cycles\": %d, \"full_ipc\": %.4f, \"error\": %.4f", full->cycles, full->cycles ? (double) full->committed / full->cycles : 0.0, error);
+	}
+	fprintf(out, "}\n");
+	if(out != stdout) fclose(out);
+
+	free(threads);
+	free(sample.jobs);
+	free(picked);
+	free(num_picked);
+	simpoint_free(&sp);
+	bbv_free(&bbv);
+	program_free(&sample.prog);
+	return 0;
+}
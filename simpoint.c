@@ -0,0 +1,235 @@
+/* Clustering of basic-block vectors ; random projection, k-means and a BIC pick of k */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#include "simpoint.h"
+
+// xorshift ; the same seed gives the same simulation points on every platform
+static double uniform(unsigned int* state) {
+	unsigned int x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return (double) x / 4294967296.0;
+}
+
+static double dist2(const double* a, const double* b) {
+	double d = 0.0;
+	for(int i=0; i<SP_DIMS; i++) {
+		d += (a[i] - b[i]) * (a[i] - b[i]);
+	}
+	return d;
+}
+
+// each interval as the fraction of its insn spent in each block, projected to SP_DIMS
+static double* project(const bbv_t* bbv, unsigned int* state) {
+	double* matrix = malloc((size_t) bbv->code_size * SP_DIMS * sizeof(double));
+	double* points = calloc((size_t) bbv->num_intervals * SP_DIMS, sizeof(double));
+	if(!matrix || !points) {
+		free(matrix);
+		free(points);
+		return NULL;
+	}
+	for(int i=0; i<bbv->code_size * SP_DIMS; i++) {
+		matrix[i] = 2.0 * uniform(state) - 1.0;
+	}
+	for(int i=0; i<bbv->num_intervals; i++) {
+		const int* row = &bbv->counts[(size_t) i * bbv->code_size];
+		double* point = &points[i * SP_DIMS];
+		for(int b=0; b<bbv->code_size; b++) {
+			if(!row[b]) continue;
+			double frac = (double) row[b] / bbv->lengths[i];
+			for(int d=0; d<SP_DIMS; d++) {
+				point[d] += frac * matrix[b * SP_DIMS + d];
+			}
+		}
+	}
+	free(matrix);
+	return points;
+}
+
+// Lloyd's iterations from a k-means++ start ; returns the squared error, assignments in cluster
+static double kmeans(const double* points, int n, int k, unsigned int* state, int* cluster, double* centers) {
+	double* d2 = malloc(n * sizeof(double));
+	int* count = malloc(k * sizeof(int));
+	if(!d2 || !count) {
+		free(d2);
+		free(count);
+		return -1.0;
+	}
+
+	// k-means++ ; each new center is drawn with probability proportional to its squared distance
+	memcpy(centers, &points[(int) (uniform(state) * n) * SP_DIMS], SP_DIMS * sizeof(double));
+	for(int i=0; i<n; i++) {
+		d2[i] = dist2(&points[i * SP_DIMS], centers);
+	}
+	for(int c=1; c<k; c++) {
+		double sum = 0.0;
+		for(int i=0; i<n; i++) {
+			sum += d2[i];
+		}
+		int pick = 0;
+		double r = uniform(state) * sum;
+		for(pick=0; pick<n-1; pick++) {
+			r -= d2[pick];
+			if(r < 0.0) break;
+		}
+		memcpy(&centers[c * SP_DIMS], &points[pick * SP_DIMS], SP_DIMS * sizeof(double));
+		for(int i=0; i<n; i++) {
+			double d = dist2(&points[i * SP_DIMS], &centers[c * SP_DIMS]);
+			if(d < d2[i]) d2[i] = d;
+		}
+	}
+
+	double error = 0.0;
+	for(int iter=0; iter<100; iter++) {
+		char changed = 0;
+		error = 0.0;
+		for(int i=0; i<n; i++) {
+			int best = 0;
+			double best_d = DBL_MAX;
+			for(int c=0; c<k; c++) {
+				double d = dist2(&points[i * SP_DIMS], &centers[c * SP_DIMS]);
+				if(d < best_d) {
+					best_d = d;
+					best = c;
+				}
+			}
+			if(iter == 0 || cluster[i] != best) changed = 1;
+			cluster[i] = best;
+			error += best_d;
+		}
+		if(!changed) break;
+
+		memset(centers, 0, k * SP_DIMS * sizeof(double));
+		memset(count, 0, k * sizeof(int));
+		for(int i=0; i<n; i++) {
+			count[cluster[i]]++;
+			for(int d=0; d<SP_DIMS; d++) {
+				centers[cluster[i] * SP_DIMS + d] += points[i * SP_DIMS + d];
+			}
+		}
+		for(int c=0; c<k; c++) {
+			for(int d=0; d<SP_DIMS; d++) {
+				if(count[c]) centers[c * SP_DIMS + d] /= count[c];
+				else centers[c * SP_DIMS + d] = points[(int) (uniform(state) * n) * SP_DIMS + d]; // an empty cluster restarts on some interval
+			}
+		}
+	}
+	free(count);
+	free(d2);
+	return error;
+}
+
+// Bayesian information criterion of a spherical Gaussian mixture, as in X-means ; higher is better
+static double bic(const int* cluster, int n, int k, double error) {
+	if(n <= k) return -DBL_MAX;
+	double var = error / ((double) SP_DIMS * (n - k));
+	if(var < 1e-12) var = 1e-12; // every interval on its center
+	int* size = calloc(k, sizeof(int));
+	if(!size) return -DBL_MAX;
+	for(int i=0; i<n; i++) {
+		size[cluster[i]]++;
+	}
+	double loglik = -0.5 * n * SP_DIMS * log(2.0 * M_PI * var) - 0.5 * SP_DIMS * (n - k);
+	for(int c=0; c<k; c++) {
+		if(size[c]) loglik += size[c] * log((double) size[c] / n);
+	}
+	free(size);
+	double params = k * (SP_DIMS + 1.0);
+	return loglik - 0.5 * params * log((double) n);
+}
+
+void simpoint_free(simpoint_t* sp) {
+	free(sp->cluster);
+	free(sp->rep);
+	free(sp->weight);
+	free(sp->dist);
+	memset(sp, 0, sizeof(simpoint_t));
+}
+
+int simpoint_cluster(const bbv_t* bbv, int max_k, unsigned int seed, simpoint_t* sp) {
+	memset(sp, 0, sizeof(simpoint_t));
+	int n = bbv->num_intervals;
+	if(n < 1) return -1;
+	if(max_k > SP_MAX_K) max_k = SP_MAX_K;
+	if(max_k > n) max_k = n;
+	if(max_k < 1) max_k = 1;
+
+	unsigned int state = seed ? seed : 1;
+	double* points = project(bbv, &state);
+	int* all_clusters = malloc((size_t) max_k * n * sizeof(int)); // the best clustering for every k
+	double* all_centers = malloc((size_t) max_k * max_k * SP_DIMS * sizeof(double));
+	int* cluster = malloc(n * sizeof(int));
+	double* centers = malloc(max_k * SP_DIMS * sizeof(double));
+	double* score = malloc(max_k * sizeof(double));
+	sp->cluster = malloc(n * sizeof(int));
+	sp->dist = malloc(n * sizeof(double));
+	if(!points || !all_clusters || !all_centers || !cluster || !centers || !score || !sp->cluster || !sp->dist) {
+		free(points);
+		free(all_clusters);
+		free(all_centers);
+		free(cluster);
+		free(centers);
+		free(score);
+		simpoint_free(sp);
+		return -1;
+	}
+
+	double min_score = DBL_MAX, max_score = -DBL_MAX;
+	for(int k=1; k<=max_k; k++) {
+		double best = DBL_MAX;
+		for(int s=0; s<SP_SEEDS; s++) {
+			double error = kmeans(points, n, k, &state, cluster, centers);
+			if(error < 0.0 || error >= best) continue;
+			best = error;
+			memcpy(&all_clusters[(size_t) (k - 1) * n], cluster, n * sizeof(int));
+			memcpy(&all_centers[(size_t) (k - 1) * max_k * SP_DIMS], centers, k * SP_DIMS * sizeof(double));
+		}
+		score[k - 1] = bic(&all_clusters[(size_t) (k - 1) * n], n, k, best);
+		if(score[k - 1] == -DBL_MAX) continue;
+		if(score[k - 1] < min_score) min_score = score[k - 1];
+		if(score[k - 1] > max_score) max_score = score[k - 1];
+	}
+	sp->k = 1;
+	for(int k=1; k<=max_k; k++) {
+		if(score[k - 1] != -DBL_MAX && score[k - 1] >= min_score + SP_BIC_THRESHOLD * (max_score - min_score)) {
+			sp->k = k;
+			break;
+		}
+	}
+
+	memcpy(sp->cluster, &all_clusters[(size_t) (sp->k - 1) * n], n * sizeof(int));
+	const double* chosen = &all_centers[(size_t) (sp->k - 1) * max_k * SP_DIMS];
+	sp->rep = malloc(sp->k * sizeof(int));
+	sp->weight = calloc(sp->k, sizeof(double));
+	int ret = (sp->rep && sp->weight) ? 0 : -1;
+	if(!ret) {
+		for(int c=0; c<sp->k; c++) {
+			sp->rep[c] = -1;
+		}
+		for(int i=0; i<n; i++) {
+			int c = sp->cluster[i];
+			sp->dist[i] = sqrt(dist2(&points[i * SP_DIMS], &chosen[c * SP_DIMS]));
+			sp->weight[c] += (double) bbv->lengths[i] / bbv->total_insn;
+			// a short last interval only stands in for its cluster if nothing else does
+			int r = sp->rep[c];
+			char full = bbv->lengths[i] == bbv->interval;
+			char r_full = r != -1 && bbv->lengths[r] == bbv->interval;
+			if(r == -1 || (full != r_full ? full : sp->dist[i] < sp->dist[r])) sp->rep[c] = i;
+		}
+	}
+
+	free(points);
+	free(all_clusters);
+	free(all_centers);
+	free(cluster);
+	free(centers);
+	free(score);
+	if(ret) simpoint_free(sp);
+	return ret;
+}
@@ -0,0 +1,44 @@
+#ifndef SIMPOINT_H
+#define SIMPOINT_H
+
+#include "cpu.h"
+
+/*
+
+	Sampled simulation, SimPoint style ; a functional run splits the program into fixed-size intervals
+	and records a basic-block vector for each, k-means groups intervals that run the same code,
+	and one detailed interval per group stands in for the whole group
+
+*/
+
+#define SP_DIMS 15 // random projection of the vectors before clustering
+#define SP_MAX_K 64
+#define SP_SEEDS 5 // k-means starts per k ; the one with the least error is kept
+#define SP_BIC_THRESHOLD 0.9 // smallest k whose BIC reaches this fraction of the best one's range
+
+// basic-block vectors of one functional run ; a block is named by the code index of its first insn
+typedef struct bbv_t {
+	int interval; // insn per interval
+	int num_intervals;
+	int code_size; // columns of counts
+	int* counts; // num_intervals rows ; insn executed in each block
+	int* lengths; // insn in each interval ; only the last one may be short
+	int total_insn;
+	char completed; // reached the HALT
+} bbv_t;
+
+typedef struct simpoint_t {
+	int k;
+	int* cluster; // cluster of each interval
+	int* rep; // representative interval of each cluster ; closest to its centroid
+	double* weight; // fraction of all insn in each cluster
+	double* dist; // distance of each interval to its centroid
+} simpoint_t;
+
+int cpu_profile(cpu_t* cpu, int interval, int max_insn, bbv_t* bbv); // functional run from the start, up to max_insn (<= 0 for no limit) ; 0 on success
+void bbv_free(bbv_t* bbv);
+
+int simpoint_cluster(const bbv_t* bbv, int max_k, unsigned int seed, simpoint_t* sp); // 0 on success
+void simpoint_free(simpoint_t* sp);
+
+#endif // SIMPOINT_H
@@ -0,0 +1,244 @@
+/* Design-space sweep ; runs one program on a grid of machine configurations */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h> // sysconf()
+
+#include "cpu.h"
+#include "config.h"
+
+#define MAX_AXES 16
+#define MAX_AXIS_VALUES 256
+
+// one swept parameter and the values it takes
+typedef struct axis_t {
+	const char* key;
+	int num_values;
+	int values[MAX_AXIS_VALUES];
+} axis_t;
+
+typedef struct point_t {
+	config_t config;
+	int cycles;
+	int committed;
+	int mispredicts;
+	char completed;
+	char failed; // cpu could not be built for this configuration
+} point_t;
+
+// shared by every worker ; next_point is the only field written after start
+typedef struct sweep_t {
+	program_t prog;
+	int max_cycles;
+	int ff_insn; // cpu_fast_forward() arguments ; ff_insn 0 and ff_pc -1 for none
+	int ff_pc;
+
+	point_t* points;
+	int num_points;
+
+	pthread_mutex_t lock;
+	int next_point;
+} sweep_t;
+
+void print_args() {
+	printf("./sweep [--threads N] [--max-cycles N] [--output file.csv] [--config file] [--fast-forward N | --fast-forward-pc <pc>] --<key> <values> ... <file.asm>\n");
+	printf("values: comma-separated list (16,32,64 or gshare,tage) or range first:last[:step] (16:128:16)\n");
+}
+
+// parses "16,32,64", "gshare,tage" or "16:128:16" into the axis ; -1 on a malformed list
+static int parse_values(axis_t* axis, const char* str) {
+	int first, last, step = 1;
+	int n = sscanf(str, "%d:%d:%d", &first, &last, &step);
+	if(n >= 2 && strchr(str, ':')) {
+		if(step <= 0 || last < first) return -1;
+		for(int v=first; v<=last; v+=step) {
+			if(axis->num_values == MAX_AXIS_VALUES) return -1;
+			axis->values[axis->num_values++] = v;
+		}
+		return 0;
+	}
+
+	// names or numbers, whatever config_set() takes for this key
+	const char* p = str;
+	while(*p) {
+		char value[64];
+		size_t len = strcspn(p, ",");
+		if(len >= sizeof(value) || axis->num_values == MAX_AXIS_VALUES) return -1;
+		memcpy(value, p, len);
+		value[len] = '\0';
+		if(config_value(axis->key, value, &axis->values[axis->num_values])) return -1;
+		axis->num_values++;
+		p += len;
+		if(*p == ',') p++;
+	}
+	return axis->num_values ? 0 : -1;
+}
+
+// point index -> value of each axis ; the last axis varies fastest
+static void point_values(int idx, axis_t* axes, int num_axes, int* values) {
+	for(int a=num_axes-1; a>=0; a--) {
+		values[a] = axes[a].values[idx % axes[a].num_values];
+		idx /= axes[a].num_values;
+	}
+}
+
+static void* worker(void* arg) {
+	sweep_t* sweep = arg;
+	while(1) {
+		pthread_mutex_lock(&sweep->lock);
+		int idx = sweep->next_point++;
+		pthread_mutex_unlock(&sweep->lock);
+		if(idx >= sweep->num_points) break;
+
+		point_t* point = &sweep->points[idx];
+		if(point->failed) continue;
+		cpu_t* cpu = cpu_init_program(&sweep->prog, &point->config, 1);
+		if(!cpu) {
+			point->failed = 1;
+			continue;
+		}
+		cpu->stop_cycle = sweep->max_cycles;
+		if((sweep->ff_insn > 0 || sweep->ff_pc != -1) && cpu_fast_forward(cpu, sweep->ff_insn, sweep->ff_pc) < 0) {
+			point->failed = 1;
+			cpu_stop(cpu);
+			continue;
+		}
+		if(!cpu->done) cpu_run(cpu, "simulate");
+
+		point->cycles = cpu->clock;
+		point->committed = cpu->committed;
+		point->mispredicts = cpu->bpred.mispredicts;
+		point->completed = cpu->done;
+		cpu_stop(cpu);
+	}
+	return NULL;
+}
+
+static void print_results(FILE* out, sweep_t* sweep, axis_t* axes, int num_axes) {
+	for(int a=0; a<num_axes; a++) {
+		fprintf(out, "%s,", axes[a].key);
+	}
+	fprintf(out, "cycles,committed,ipc,mispredicts,completed\n");
+
+	for(int i=0; i<sweep->num_points; i++) {
+		point_t* point = &sweep->points[i];
+		int values[MAX_AXES];
+		point_values(i, axes, num_axes, values);
+		for(int a=0; a<num_axes; a++) {
+			const char* name = config_value_name(axes[a].key, values[a]);
+			if(name) fprintf(out, "%s,", name);
+			else fprintf(out, "%d,", values[a]);
+		}
+		if(point->failed) {
+			fprintf(out, ",,,,failed\n");
+			continue;
+		}
+		double ipc = point->cycles ? (double) point->committed / point->cycles : 0.0;
+		fprintf(out, "%d,%d,%.4f,%d,%s\n", point->cycles, point->committed, ipc, point->mispredicts, point->completed ? "yes" : "no");
+	}
+}
+
+int main(int argc, char* argv[]) {
+	int num_threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	int max_cycles = 1000000; // a configuration that deadlocks must not stall the sweep
+	int ff_insn = 0;
+	int ff_pc = -1;
+	const char* output = NULL;
+	const char* filename = NULL;
+
+	config_t base;
+	config_default(&base);
+	axis_t axes[MAX_AXES];
+	int num_axes = 0;
+
+	for(int i=1; i<argc; i++) {
+		if(strcmp(argv[i], "--threads") == 0 && i+1 < argc) num_threads = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--max-cycles") == 0 && i+1 < argc) max_cycles = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--output") == 0 && i+1 < argc) output = argv[++i];
+		else if(strcmp(argv[i], "--fast-forward") == 0 && i+1 < argc) ff_insn = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--fast-forward-pc") == 0 && i+1 < argc) ff_pc = (int) strtol(argv[++i], NULL, 0);
+		else if(strcmp(argv[i], "--config") == 0 && i+1 < argc) {
+			if(config_load(&base, argv[++i])) exit(1);
+		}
+		else if(strncmp(argv[i], "--", 2) == 0 && i+1 < argc && num_axes < MAX_AXES) {
+			axis_t* axis = &axes[num_axes];
+			axis->key = argv[i] + 2;
+			axis->num_values = 0;
+			config_t probe = base;
+			if(config_set(&probe, axis->key, "1") || parse_values(axis, argv[i+1])) {
+				fprintf(stderr, "sweep> Invalid parameter or values: %s %s\n", argv[i], argv[i+1]);
+				exit(1);
+			}
+			num_axes++;
+			i++;
+		}
+		else if(argv[i][0] != '-' && !filename) filename = argv[i];
+		else {
+			print_args();
+			exit(1);
+		}
+	}
+	if(!filename) {
+		print_args();
+		exit(1);
+	}
+	if(num_threads < 1) num_threads = 1;
+
+	sweep_t sweep;
+	if(program_load(filename, &sweep.prog)) {
+		fprintf(stderr, "sweep> Failed to load %s\n", filename);
+		exit(1);
+	}
+	sweep.max_cycles = max_cycles;
+	sweep.ff_insn = ff_insn;
+	sweep.ff_pc = ff_pc;
+
+	// cartesian product of every axis
+	sweep.num_points = 1;
+	for(int a=0; a<num_axes; a++) {
+		sweep.num_points *= axes[a].num_values;
+	}
+	sweep.points = calloc(sweep.num_points, sizeof(point_t));
+	if(!sweep.points) exit(1);
+	for(int i=0; i<sweep.num_points; i++) {
+		point_t* point = &sweep.points[i];
+		point->config = base;
+		int values[MAX_AXES];
+		point_values(i, axes, num_axes, values);
+		for(int a=0; a<num_axes; a++) {
+			char value[16];
+			snprintf(value, sizeof(value), "%d", values[a]);
+			if(config_set(&point->config, axes[a].key, value)) point->failed = 1;
+		}
+	}
+
+	pthread_mutex_init(&sweep.lock, NULL);
+	sweep.next_point = 0;
+	if(num_threads > sweep.num_points) num_threads = sweep.num_points;
+	pthread_t* threads = malloc(num_threads * sizeof(pthread_t));
+	for(int t=0; t<num_threads; t++) {
+		pthread_create(&threads[t], NULL, worker, &sweep);
+	}
+	for(int t=0; t<num_threads; t++) {
+		pthread_join(threads[t], NULL);
+	}
+	pthread_mutex_destroy(&sweep.lock);
+
+	FILE* out = stdout;
+	if(output) {
+		out = fopen(output, "w");
+		if(!out) {
+			fprintf(stderr, "sweep> Could not open %s\n", output);
+			exit(1);
+		}
+	}
+	print_results(out, &sweep, axes, num_axes);
+	if(out != stdout) fclose(out);
+
+	free(threads);
+	free(sweep.points);
+	program_free(&sweep.prog);
+	return 0;
+}
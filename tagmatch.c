@@ -0,0 +1,56 @@
+/* Tag compares over packed tag arrays ; vector paths picked at run time, scalar fallback */
+
+#include "tagmatch.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TAG_MATCH_X86
+#include <immintrin.h>
+#endif
+
+// entries from i on, one at a time
+static void match_scalar(const int* tags, int i, int n, int tag, uint64_t* mask) {
+	for(; i<n; i++) {
+		if(tags[i] == tag) mask[i / 64] |= (uint64_t) 1 << (i % 64);
+	}
+}
+
+#ifdef TAG_MATCH_X86
+// 8 entries per compare ; a block never straddles two mask words since 64 is a multiple of 8
+__attribute__((target("avx2")))
+static void match_avx2(const int* tags, int n, int tag, uint64_t* mask) {
+	__m256i key = _mm256_set1_epi32(tag);
+	int i = 0;
+	for(; i+8<=n; i+=8) {
+		__m256i eq = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*) &tags[i]), key);
+		uint64_t bits = (unsigned int) _mm256_movemask_ps(_mm256_castsi256_ps(eq));
+		mask[i / 64] |= bits << (i % 64);
+	}
+	match_scalar(tags, i, n, tag, mask);
+}
+
+__attribute__((target("sse2")))
+static void match_sse2(const int* tags, int n, int tag, uint64_t* mask) {
+	__m128i key = _mm_set1_epi32(tag);
+	int i = 0;
+	for(; i+4<=n; i+=4) {
+		__m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*) &tags[i]), key);
+		uint64_t bits = (unsigned int) _mm_movemask_ps(_mm_castsi128_ps(eq));
+		mask[i / 64] |= bits << (i % 64);
+	}
+	match_scalar(tags, i, n, tag, mask);
+}
+#endif
+
+void tag_match(const int* tags, int n, int tag, uint64_t* mask) {
+#ifdef TAG_MATCH_X86
+	if(__builtin_cpu_supports("avx2")) {
+		match_avx2(tags, n, tag, mask);
+		return;
+	}
+	if(__builtin_cpu_supports("sse2")) {
+		match_sse2(tags, n, tag, mask);
+		return;
+	}
+#endif
+	match_scalar(tags, 0, n, tag, mask);
+}
@@ -0,0 +1,16 @@
+#ifndef TAGMATCH_H
+#define TAGMATCH_H
+
+#include <stdint.h>
+
+/*
+
+	Tag compares over packed tag arrays ; one tag against every entry, the result a bitmap like those in bitmap.h
+
+	AVX2 when the CPU has it, SSE2 otherwise on x86, plain C everywhere else ; every path gives the same bits
+
+*/
+
+void tag_match(const int* tags, int n, int tag, uint64_t* mask); // sets bit i of mask where tags[i] == tag ; other bits are left alone
+
+#endif // TAGMATCH_H
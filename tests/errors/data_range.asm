@@ -0,0 +1,10 @@
+; must fail to assemble with a file:line diagnostic, not hang or allocate the address space
+; line 5: .data address 1100000000 out of range ; line 10: out of range once the words run past the end of memory
+MOVC,R0,#0
+HALT
+.data #1100000000
+5
+.data #16777214
+1
+2
+3
@@ -0,0 +1,6 @@
+MOVC,R1,#100000000
+MOVC,R2,#0
+MUL,R3,R2,R2
+BZ,#8
+LOAD,R4,R1,#0
+HALT
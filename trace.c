@@ -0,0 +1,64 @@
+/* Binary pipeline trace ; writer used by the simulator, reader used by traceview */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+
+trace_t* trace_open(const char* filename) {
+	trace_t* trace = calloc(1, sizeof(trace_t));
+	if(!trace) return NULL;
+	trace->block = malloc(TRACE_BLOCK * sizeof(trace_rec_t));
+	trace->file = fopen(filename, "wb");
+	if(!trace->block || !trace->file) {
+		if(trace->file) fclose(trace->file);
+		free(trace->block);
+		free(trace);
+		return NULL;
+	}
+
+	trace_header_t header;
+	memcpy(header.magic, TRACE_MAGIC, 4);
+	header.version = TRACE_VERSION;
+	header.rec_size = sizeof(trace_rec_t);
+	fwrite(&header, sizeof(header), 1, trace->file);
+	return trace;
+}
+
+static int trace_flush(trace_t* trace) {
+	if(!trace->num) return 0;
+	int num = trace->num;
+	trace->num = 0;
+	trace->records += num;
+	return fwrite(trace->block, sizeof(trace_rec_t), num, trace->file) == (size_t) num ? 0 : -1;
+}
+
+void trace_write(trace_t* trace, const trace_rec_t* rec) {
+	trace->block[trace->num++] = *rec;
+	if(trace->num == TRACE_BLOCK) trace_flush(trace);
+}
+
+int trace_close(trace_t* trace) {
+	int ret = trace_flush(trace);
+	if(fclose(trace->file)) ret = -1;
+	free(trace->block);
+	free(trace);
+	return ret;
+}
+
+FILE* trace_open_read(const char* filename) {
+	FILE* file = fopen(filename, "rb");
+	if(!file) return NULL;
+
+	trace_header_t header;
+	if(fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, TRACE_MAGIC, 4) || header.version != TRACE_VERSION || header.rec_size != sizeof(trace_rec_t)) {
+		fclose(file);
+		return NULL;
+	}
+	setvbuf(file, NULL, _IOFBF, TRACE_BLOCK * sizeof(trace_rec_t) / 16);
+	return file;
+}
+
+int trace_read(FILE* file, trace_rec_t* rec) {
+	return fread(rec, sizeof(trace_rec_t), 1, file) == 1;
+}
@@ -0,0 +1,53 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h> // FILE
+#include <stdint.h>
+
+/*
+
+	Pipeline trace ; one fixed-size binary record per insn event, buffered and written in large blocks
+
+*/
+
+#define TRACE_MAGIC "APXT"
+#define TRACE_VERSION 1
+#define TRACE_BLOCK 65536 // records per write
+
+// lifecycle events of one insn
+enum { TR_FETCH, TR_RENAME, TR_DISPATCH, TR_ISSUE, TR_MEMORY, TR_COMPLETE, TR_COMMIT, TR_SQUASH, NUM_TRACE_EVENTS };
+
+typedef struct trace_header_t {
+	char magic[4];
+	uint32_t version;
+	uint32_t rec_size; // sizeof(trace_rec_t) of the writer
+} trace_header_t;
+
+typedef struct trace_rec_t {
+	uint32_t seq; // insn id, in fetch order
+	uint32_t cycle;
+	int32_t pc;
+	int16_t rob_idx; // -1 if the insn has none (yet)
+	int16_t iq_idx;
+	int16_t lsq_idx;
+	int16_t cfid;
+	uint8_t event; // TR_*
+	uint8_t opcode;
+	uint8_t pad[2];
+} trace_rec_t;
+
+typedef struct trace_t {
+	FILE* file;
+	trace_rec_t* block;
+	int num; // records waiting in block
+	long records; // written so far
+} trace_t;
+
+trace_t* trace_open(const char* filename); // NULL on failure
+void trace_write(trace_t* trace, const trace_rec_t* rec);
+int trace_close(trace_t* trace); // flushes the last block ; 0 on success
+
+FILE* trace_open_read(const char* filename); // checks the header ; NULL if not a trace of this version
+int trace_read(FILE* file, trace_rec_t* rec); // 1 if a record was read, 0 at the end
+
+#endif // TRACE_H
@@ -0,0 +1,206 @@
+/* Converts a binary pipeline trace to Kanata (Konata) or gem5 O3PipeView text */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpu.h"
+#include "trace.h"
+
+#define WINDOW (1 << 16) // insn in flight at once ; far more than any ROB plus front-end
+#define TICKS_PER_CYCLE 1000 // O3PipeView counts in ticks ; gem5 tools assume 1000 per cycle
+
+// one in-flight insn, indexed by seq % WINDOW
+typedef struct insn_state_t {
+	char live;
+	char retired;
+	uint32_t seq;
+	int pc;
+	int opcode;
+	const char* stage; // Kanata stage in progress ; NULL if none
+	uint32_t fetch, rename, dispatch, issue, complete, retire, store; // cycles ; 0 if not reached
+} insn_state_t;
+
+static insn_state_t* window;
+static program_t prog; // optional ; gives operands to the disassembly
+
+void print_args() {
+	printf("./traceview [--o3] [--asm file.asm] [--output file] <trace>\n");
+	printf("  default output is Kanata 0004 for Konata ; --o3 writes gem5 O3PipeView lines\n");
+	printf("  --asm adds operands to the disassembly ; must be the traced program\n");
+}
+
+static const char* disasm(int pc, int opcode) {
+	static char buf[64];
+	int idx = (pc - CODE_START_ADDR) / 4;
+	if(!prog.code || idx < 0 || idx >= prog.code_size) {
+		snprintf(buf, sizeof(buf), "%s", opcode_names[opcode]);
+		return buf;
+	}
+
+	const insn_t* insn = &prog.code[idx];
+	unsigned short props = opcode_props[insn->opcode];
+	int n = snprintf(buf, sizeof(buf), "%s", opcode_names[insn->opcode]);
+	char sep = ' ';
+	if(props & OPP_RD) { n += snprintf(buf + n, sizeof(buf) - n, "%cR%d", sep, insn->rd); sep = ','; }
+	if(props & OPP_RS1) { n += snprintf(buf + n, sizeof(buf) - n, "%cR%d", sep, insn->rs1); sep = ','; }
+	if(props & OPP_RS2) { n += snprintf(buf + n, sizeof(buf) - n, "%cR%d", sep, insn->rs2); sep = ','; }
+	if(insn->opcode != OP_HALT && (!(props & OPP_RS2) || (props & OPP_MEM))) snprintf(buf + n, sizeof(buf) - n, "%c#%d", sep, insn->imm);
+	return buf;
+}
+
+/* Kanata ; streamed, one command per event */
+
+static void kanata_stage(FILE* out, insn_state_t* s, const char* stage) {
+	if(s->stage) fprintf(out, "E\t%u\t0\t%s\n", s->seq, s->stage);
+	s->stage = stage;
+	if(stage) fprintf(out, "S\t%u\t0\t%s\n", s->seq, stage);
+}
+
+static int kanata(FILE* in, FILE* out) {
+	static const char* const stages[NUM_TRACE_EVENTS] = { "F", "Rn", "Ds", "Is", "Mem", "Cm", NULL, NULL };
+	trace_rec_t rec;
+	char first = 1;
+	uint32_t cycle = 0;
+	uint32_t retired = 0;
+
+	fprintf(out, "Kanata\t0004\n");
+	while(trace_read(in, &rec)) {
+		if(first) fprintf(out, "C=\t%u\n", rec.cycle);
+		else if(rec.cycle != cycle) fprintf(out, "C\t%u\n", rec.cycle - cycle);
+		first = 0;
+		cycle = rec.cycle;
+
+		insn_state_t* s = &window[rec.seq % WINDOW];
+		if(rec.event == TR_FETCH) {
+			memset(s, 0, sizeof(insn_state_t));
+			s->live = 1;
+			s->seq = rec.seq;
+			fprintf(out, "I\t%u\t%u\t0\n", rec.seq, rec.seq);
+			fprintf(out, "L\t%u\t0\t%x: %s\n", rec.seq, rec.pc, disasm(rec.pc, rec.opcode));
+		}
+		if(!s->live || s->seq != rec.seq) continue; // fetched before the trace started, or a STORE written after it retired
+
+		if(rec.event == TR_COMMIT || rec.event == TR_SQUASH) {
+			kanata_stage(out, s, NULL);
+			fprintf(out, "R\t%u\t%u\t%d\n", rec.seq, rec.event == TR_COMMIT ? retired++ : rec.seq, rec.event == TR_SQUASH);
+			s->live = 0;
+		} else {
+			kanata_stage(out, s, stages[rec.event]);
+		}
+	}
+	return 0;
+}
+
+/* O3PipeView ; one block per insn once it leaves the pipeline */
+
+static void o3_emit(FILE* out, insn_state_t* s) {
+	#define TICKS(c) ((unsigned long) (c) * TICKS_PER_CYCLE)
+	fprintf(out, "O3PipeView:fetch:%lu:0x%08x:0:%u:%s\n", TICKS(s->fetch), s->pc, s->seq, disasm(s->pc, s->opcode));
+	fprintf(out, "O3PipeView:decode:%lu\n", TICKS(s->rename)); // decode and rename are one stage here
+	fprintf(out, "O3PipeView:rename:%lu\n", TICKS(s->rename));
+	fprintf(out, "O3PipeView:dispatch:%lu\n", TICKS(s->dispatch));
+	fprintf(out, "O3PipeView:issue:%lu\n", TICKS(s->issue));
+	fprintf(out, "O3PipeView:complete:%lu\n", TICKS(s->complete));
+	fprintf(out, "O3PipeView:retire:%lu:store:%lu\n", TICKS(s->retire), TICKS(s->store));
+	#undef TICKS
+	s->live = 0;
+}
+
+static int o3(FILE* in, FILE* out) {
+	trace_rec_t rec;
+	uint32_t last_seq = 0;
+	while(trace_read(in, &rec)) {
+		insn_state_t* s = &window[rec.seq % WINDOW];
+		if(rec.event == TR_FETCH) {
+			if(s->live) o3_emit(out, s); // still in flight WINDOW insn later ; should not happen
+			memset(s, 0, sizeof(insn_state_t));
+			s->live = 1;
+			s->seq = rec.seq;
+			s->pc = rec.pc;
+			s->opcode = rec.opcode;
+			s->fetch = rec.cycle;
+			last_seq = rec.seq;
+			continue;
+		}
+		if(!s->live || s->seq != rec.seq) continue;
+
+		switch(rec.event) {
+			case TR_RENAME: s->rename = rec.cycle; break;
+			case TR_DISPATCH: s->dispatch = rec.cycle; break;
+			case TR_ISSUE: if(!s->issue) s->issue = rec.cycle; break; // LOAD and STORE issue again to memFU
+			case TR_MEMORY: if(rec.opcode == OP_STORE) s->complete = rec.cycle; break;
+			case TR_COMPLETE:
+				if(s->retired) { // a STORE retires when it starts writing memory
+					s->store = rec.cycle;
+					o3_emit(out, s);
+				} else s->complete = rec.cycle;
+				break;
+			case TR_COMMIT:
+				s->retire = rec.cycle;
+				s->retired = 1;
+				if(rec.opcode != OP_STORE) o3_emit(out, s);
+				break;
+			case TR_SQUASH: o3_emit(out, s); break; // retire stays 0
+		}
+	}
+
+	// still in flight when the run stopped ; oldest first
+	for(uint32_t i=1; i<=WINDOW; i++) {
+		insn_state_t* s = &window[(last_seq + i) % WINDOW];
+		if(s->live) o3_emit(out, s);
+	}
+	return 0;
+}
+
+int main(int argc, char* argv[]) {
+	char use_o3 = 0;
+	const char* asm_file = NULL;
+	const char* output = NULL;
+	const char* filename = NULL;
+	for(int i=1; i<argc; i++) {
+		if(strcmp(argv[i], "--o3") == 0) use_o3 = 1;
+		else if(strcmp(argv[i], "--asm") == 0 && i+1 < argc) asm_file = argv[++i];
+		else if(strcmp(argv[i], "--output") == 0 && i+1 < argc) output = argv[++i];
+		else if(argv[i][0] != '-' && !filename) filename = argv[i];
+		else {
+			print_args();
+			exit(1);
+		}
+	}
+	if(!filename) {
+		print_args();
+		exit(1);
+	}
+
+	FILE* in = trace_open_read(filename);
+	if(!in) {
+		fprintf(stderr, "traceview> %s is not a version %d trace\n", filename, TRACE_VERSION);
+		exit(1);
+	}
+	if(asm_file) {
+		if(program_load(asm_file, &prog)) {
+			fprintf(stderr, "traceview> Failed to load %s\n", asm_file);
+			exit(1);
+		}
+	}
+	FILE* out = stdout;
+	if(output) {
+		out = fopen(output, "w");
+		if(!out) {
+			fprintf(stderr, "traceview> Could not open %s\n", output);
+			exit(1);
+		}
+	}
+	window = calloc(WINDOW, sizeof(insn_state_t));
+	if(!window) exit(1);
+
+	if(use_o3) o3(in, out);
+	else kanata(in, out);
+
+	if(out != stdout) fclose(out);
+	fclose(in);
+	free(window);
+	program_free(&prog);
+	return 0;
+}